@@ -0,0 +1,150 @@
+#include "accel_codec.h"
+
+#define AXES 3
+
+static uint16_t zigzag(int16_t value) {
+    return (uint16_t) (value * 2) ^ (uint16_t) (value >> 15);
+}
+
+static int16_t unzigzag(uint16_t value) {
+    return (int16_t) ((value >> 1) ^ -(value & 1));
+}
+
+static void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xff;
+    out[1] = value >> 8;
+}
+
+static uint16_t get_u16(const uint8_t* in) {
+    return in[0] | (in[1] << 8);
+}
+
+static int bit_width(uint16_t value) {
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+// samples of every axis, step is 3 for interleaved frames and 1 for separate arrays
+typedef struct {
+    const int16_t* axes[AXES];
+    size_t step;
+} samples_t;
+
+static int16_t sample_at(const samples_t* samples, size_t frame, int axis) {
+    return samples->axes[axis][frame * samples->step];
+}
+
+// difference to the previous sample of the axis, wrapping keeps it in 16 bits and still lossless
+static uint16_t delta_at(const samples_t* samples, size_t frame, int axis) {
+    return zigzag((int16_t) (sample_at(samples, frame, axis) - sample_at(samples, frame - 1, axis)));
+}
+
+static size_t encode_raw(const samples_t* samples, size_t frame_count, uint8_t* out) {
+    put_u16(out, frame_count | ACCEL_CODEC_RAW_FLAG);
+    for (size_t frame = 0; frame < frame_count; frame++) {
+        for (int axis = 0; axis < AXES; axis++)
+            put_u16(out + sizeof(uint16_t) + (frame * AXES + axis) * sizeof(int16_t), sample_at(samples, frame, axis));
+    }
+    return ACCEL_CODEC_MAX_SIZE(frame_count);
+}
+
+static size_t encode(const samples_t* samples, size_t frame_count, uint8_t* out) {
+    size_t raw_size = ACCEL_CODEC_MAX_SIZE(frame_count);
+    if (frame_count == 0)
+        return encode_raw(samples, 0, out);
+
+    put_u16(out, frame_count);
+    size_t pos = sizeof(uint16_t);
+    for (int axis = 0; axis < AXES; axis++, pos += sizeof(int16_t))
+        put_u16(out + pos, sample_at(samples, 0, axis));
+
+    for (int axis = 0; axis < AXES; axis++) {
+        for (size_t start = 1; start < frame_count; start += ACCEL_CODEC_GROUP_SIZE) {
+            size_t end = start + ACCEL_CODEC_GROUP_SIZE < frame_count ? start + ACCEL_CODEC_GROUP_SIZE : frame_count;
+            uint16_t all_bits = 0;
+            for (size_t frame = start; frame < end; frame++)
+                all_bits |= delta_at(samples, frame, axis);
+            int width = bit_width(all_bits);
+
+            size_t group_size = 1 + (width * (end - start) + 7) / 8;
+            // packing does not pay off, e.g. for noise
+            if (pos + group_size >= raw_size)
+                return encode_raw(samples, frame_count, out);
+            out[pos++] = width;
+
+            uint32_t bits = 0;
+            int bits_count = 0;
+            for (size_t frame = start; frame < end; frame++) {
+                bits |= (uint32_t) delta_at(samples, frame, axis) << bits_count;
+                bits_count += width;
+                while (bits_count >= 8) {
+                    out[pos++] = bits & 0xff;
+                    bits >>= 8;
+                    bits_count -= 8;
+                }
+            }
+            if (bits_count > 0)
+                out[pos++] = bits & 0xff;
+        }
+    }
+    return pos;
+}
+
+size_t accel_codec_encode(const int16_t* frames, size_t frame_count, uint8_t* out) {
+    samples_t samples = { .axes = {frames, frames + 1, frames + 2}, .step = AXES };
+    return encode(&samples, frame_count, out);
+}
+
+size_t accel_codec_encode_axes(const int16_t* x, const int16_t* y, const int16_t* z, size_t frame_count, uint8_t* out) {
+    samples_t samples = { .axes = {x, y, z}, .step = 1 };
+    return encode(&samples, frame_count, out);
+}
+
+esp_err_t accel_codec_decode(const uint8_t* block, size_t size, int16_t* frames, size_t max_frames, size_t* frame_count) {
+    if (size < sizeof(uint16_t))
+        return ESP_ERR_INVALID_SIZE;
+    uint16_t header = get_u16(block);
+    size_t count = header & ~ACCEL_CODEC_RAW_FLAG;
+    if (count > max_frames)
+        return ESP_ERR_INVALID_SIZE;
+    *frame_count = count;
+
+    if (header & ACCEL_CODEC_RAW_FLAG || count == 0) {
+        if (size < ACCEL_CODEC_MAX_SIZE(count))
+            return ESP_ERR_INVALID_SIZE;
+        for (size_t i = 0; i < count * AXES; i++)
+            frames[i] = get_u16(block + sizeof(uint16_t) + i * sizeof(int16_t));
+        return ESP_OK;
+    }
+
+    size_t pos = sizeof(uint16_t);
+    if (size < pos + AXES * sizeof(int16_t))
+        return ESP_ERR_INVALID_SIZE;
+    for (int axis = 0; axis < AXES; axis++, pos += sizeof(int16_t))
+        frames[axis] = get_u16(block + pos);
+
+    for (int axis = 0; axis < AXES; axis++) {
+        for (size_t start = 1; start < count; start += ACCEL_CODEC_GROUP_SIZE) {
+            size_t end = start + ACCEL_CODEC_GROUP_SIZE < count ? start + ACCEL_CODEC_GROUP_SIZE : count;
+            if (pos >= size)
+                return ESP_ERR_INVALID_SIZE;
+            int width = block[pos++];
+            if (width > 16 || pos + (width * (end - start) + 7) / 8 > size)
+                return ESP_ERR_INVALID_SIZE;
+
+            uint32_t bits = 0;
+            int bits_count = 0;
+            uint16_t mask = (1u << width) - 1;
+            for (size_t frame = start; frame < end; frame++) {
+                while (bits_count < width) {
+                    bits |= (uint32_t) block[pos++] << bits_count;
+                    bits_count += 8;
+                }
+                uint16_t delta = bits & mask;
+                bits >>= width;
+                bits_count -= width;
+                frames[frame * AXES + axis] = (int16_t) (frames[(frame - 1) * AXES + axis] + unzigzag(delta));
+            }
+        }
+    }
+    return ESP_OK;
+}
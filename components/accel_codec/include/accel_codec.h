@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lossless codec for blocks of accelerometer frames (interleaved x, y, z).
+ *
+ * Encoded block starts with uint16_t frame count, its top bit is set when frames follow as is,
+ * which happens when packing would not make them smaller. Otherwise the first frame follows
+ * and then, for every axis, differences between consecutive samples (wrapped to 16 bits and zigzag encoded)
+ * in groups of ACCEL_CODEC_GROUP_SIZE: a byte with bit width of the group, and the group packed
+ * with that width, least significant bits first, padded to a whole byte.
+ * All values are little-endian.
+ */
+#define ACCEL_CODEC_GROUP_SIZE 16
+#define ACCEL_CODEC_RAW_FLAG 0x8000
+#define ACCEL_CODEC_MAX_FRAMES 0x7fff
+
+// encoded block is never larger than this
+#define ACCEL_CODEC_MAX_SIZE(frame_count) (sizeof(uint16_t) + (frame_count) * 3 * sizeof(int16_t))
+
+/*
+ * Encodes frame_count frames of 3 samples to out, which has space for ACCEL_CODEC_MAX_SIZE(frame_count) bytes.
+ * Returns size of the encoded block.
+ */
+size_t accel_codec_encode(const int16_t* frames, size_t frame_count, uint8_t* out);
+
+// same as accel_codec_encode(), for samples of every axis in an array of its own; the block is the same
+size_t accel_codec_encode_axes(const int16_t* x, const int16_t* y, const int16_t* z, size_t frame_count, uint8_t* out);
+
+/*
+ * Decodes a block of size bytes to frames, which has space for max_frames frames.
+ * Returns ESP_ERR_INVALID_SIZE when the block is truncated or does not fit.
+ */
+esp_err_t accel_codec_decode(const uint8_t* block, size_t size, int16_t* frames, size_t max_frames, size_t* frame_count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,124 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+
+#include "accel_codec.h"
+
+static const char* TAG = "accel_codec";
+
+#define FRAMES 170
+
+static int16_t frames[FRAMES * 3];
+static int16_t decoded[FRAMES * 3];
+static uint8_t block[ACCEL_CODEC_MAX_SIZE(FRAMES)];
+
+static void check_round_trip(size_t frame_count, size_t* encoded_size) {
+    memset(block, 0x5a, sizeof(block));
+    *encoded_size = accel_codec_encode(frames, frame_count, block);
+    TEST_ASSERT_TRUE(*encoded_size <= ACCEL_CODEC_MAX_SIZE(frame_count));
+
+    size_t decoded_count = 0;
+    memset(decoded, 0, sizeof(decoded));
+    TEST_ASSERT_EQUAL(ESP_OK, accel_codec_decode(block, *encoded_size, decoded, FRAMES, &decoded_count));
+    TEST_ASSERT_EQUAL(frame_count, decoded_count);
+    for (size_t i = 0; i < frame_count * 3; i++)
+        TEST_ASSERT_EQUAL(frames[i], decoded[i]);
+}
+
+// drum of a washing machine: gravity on z, vibration at the spin frequency and sensor noise, in mg
+static void fill_vibration(int amplitude, int noise) {
+    for (int i = 0; i < FRAMES; i++) {
+        float phase = 2 * M_PI * 13.3f * i / 100;
+        frames[i * 3] = (int16_t) (amplitude * sinf(phase) + rand() % (2 * noise + 1) - noise);
+        frames[i * 3 + 1] = (int16_t) (amplitude * cosf(phase) + rand() % (2 * noise + 1) - noise);
+        frames[i * 3 + 2] = (int16_t) (1000 + rand() % (2 * noise + 1) - noise);
+    }
+}
+
+TEST_CASE("accel_codec round trip", "[accel_codec]")
+{
+    size_t size;
+    srand(1);
+
+    // constant signal packs to widths only
+    for (int i = 0; i < FRAMES * 3; i++)
+        frames[i] = -1000;
+    check_round_trip(FRAMES, &size);
+    TEST_ASSERT_EQUAL(2 + 6 + 3 * 11, size);
+
+    // extremes wrap around in differences
+    for (int i = 0; i < FRAMES * 3; i++)
+        frames[i] = i % 2 ? INT16_MIN : INT16_MAX;
+    check_round_trip(FRAMES, &size);
+
+    // noise is stored as is
+    for (int i = 0; i < FRAMES * 3; i++)
+        frames[i] = rand();
+    check_round_trip(FRAMES, &size);
+    TEST_ASSERT_EQUAL(ACCEL_CODEC_MAX_SIZE(FRAMES), size);
+
+    for (size_t count = 0; count < 40; count++) {
+        fill_vibration(300, 20);
+        check_round_trip(count, &size);
+    }
+}
+
+TEST_CASE("accel_codec rejects truncated blocks", "[accel_codec]")
+{
+    size_t size, count;
+    srand(2);
+    fill_vibration(300, 20);
+    check_round_trip(FRAMES, &size);
+    for (size_t truncated = 0; truncated < size; truncated++)
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, accel_codec_decode(block, truncated, decoded, FRAMES, &count));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, accel_codec_decode(block, size, decoded, FRAMES - 1, &count));
+}
+
+TEST_CASE("accel_codec encodes separate axes to the same block", "[accel_codec]")
+{
+    static int16_t axes[3][FRAMES];
+    static uint8_t axes_block[ACCEL_CODEC_MAX_SIZE(FRAMES)];
+    srand(4);
+    for (int packed = 0; packed < 2; packed++) {
+        // vibration packs, noise is stored as is
+        if (packed)
+            fill_vibration(300, 20);
+        else
+            for (int i = 0; i < FRAMES * 3; i++)
+                frames[i] = rand();
+        for (int i = 0; i < FRAMES * 3; i++)
+            axes[i % 3][i / 3] = frames[i];
+
+        size_t size = accel_codec_encode(frames, FRAMES, block);
+        TEST_ASSERT_EQUAL(size, accel_codec_encode_axes(axes[0], axes[1], axes[2], FRAMES, axes_block));
+        TEST_ASSERT_EQUAL_MEMORY(block, axes_block, size);
+    }
+}
+
+TEST_CASE("accel_codec benchmark", "[accel_codec]")
+{
+    const int repeat_count = 100;
+    static const int amplitudes[] = {0, 50, 300, 1500};
+    srand(3);
+    for (size_t a = 0; a < sizeof(amplitudes) / sizeof(amplitudes[0]); a++) {
+        fill_vibration(amplitudes[a], 15);
+        size_t size = 0;
+        uint32_t start = esp_cpu_get_ccount();
+        for (int i = 0; i < repeat_count; i++)
+            size = accel_codec_encode(frames, FRAMES, block);
+        uint32_t encode_cycles = (esp_cpu_get_ccount() - start) / repeat_count;
+
+        size_t count;
+        start = esp_cpu_get_ccount();
+        for (int i = 0; i < repeat_count; i++)
+            accel_codec_decode(block, size, decoded, FRAMES, &count);
+        uint32_t decode_cycles = (esp_cpu_get_ccount() - start) / repeat_count;
+
+        ESP_LOGI(TAG, "amplitude %d mg: %zu bytes of %zu (ratio %.2f), encode %u cycles, decode %u cycles",
+            amplitudes[a], size, sizeof(frames), (float) sizeof(frames) / size, encode_cycles, decode_cycles);
+        TEST_ASSERT_TRUE(size <= ACCEL_CODEC_MAX_SIZE(FRAMES));
+    }
+}
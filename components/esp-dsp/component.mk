@@ -8,6 +8,8 @@ COMPONENT_ADD_INCLUDEDIRS := modules/dotprod/include \
 							modules/windows/nuttall/include \
 							modules/windows/flat_top/include \
 							modules/iir/include \
+							modules/goertzel/include \
+							modules/unpack/include \
 							modules/fir/include \
 							modules/math/include \
 							modules/math/add/include \
@@ -78,6 +80,12 @@ COMPONENT_SRCDIRS :=. \
 					modules/dct/float \
 					modules/iir \
 					modules/iir/biquad \
+					modules/goertzel \
+					modules/goertzel/float \
+					modules/goertzel/fixed \
+					modules/unpack \
+					modules/unpack/fixed \
+					modules/unpack/float \
 					modules/fir \
 					modules/fir/float
 					
@@ -29,6 +29,8 @@ extern "C"
 #include "dsps_fir.h"
 #include "dsps_biquad.h"
 #include "dsps_biquad_gen.h"
+#include "dsps_goertzel.h"
+#include "dsps_unpack.h"
 #include "dsps_wind.h"
 #include "dsps_conv.h"
 #include "dsps_corr.h"
@@ -207,6 +207,7 @@ esp_err_t dsps_gen_bitrev2r_table(int N, int step, char *name_ext);
 #if CONFIG_DSP_OPTIMIZED
 #define dsps_bit_rev_fc32 dsps_bit_rev_fc32_ansi
 #define dsps_cplx2reC_fc32 dsps_cplx2reC_fc32_ansi
+#define dsps_bit_rev_sc16 dsps_bit_rev_sc16_ansi
 
 #if (dsps_fft2r_fc32_aes3_enabled == 1)
 #define dsps_fft2r_fc32 dsps_fft2r_fc32_aes3
@@ -237,6 +238,7 @@ esp_err_t dsps_gen_bitrev2r_table(int N, int step, char *name_ext);
 #else // CONFIG_DSP_OPTIMIZED
 
 #define dsps_fft2r_fc32 dsps_fft2r_fc32_ansi
+#define dsps_fft2r_sc16 dsps_fft2r_sc16_ansi
 #define dsps_bit_rev_fc32 dsps_bit_rev_fc32_ansi
 #define dsps_cplx2reC_fc32 dsps_cplx2reC_fc32_ansi
 #define dsps_bit_rev_sc16 dsps_bit_rev_sc16_ansi
@@ -0,0 +1,51 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dsps_goertzel.h"
+#include <math.h>
+
+
+esp_err_t dsps_goertzel_init_s16(dsps_goertzel_s16_t *goertzel, int16_t *coeffs, int32_t *delay, const float *freqs, int bins)
+{
+    if (NULL == freqs) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+
+    goertzel->coeffs = coeffs;
+    goertzel->delay = delay;
+    goertzel->bins = bins;
+
+    for (int i = 0 ; i < bins ; i++) {
+        if ((freqs[i] < 0) || (freqs[i] > 0.5)) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+        // 2*cos(0) does not fit into Q14, so the coefficient is saturated
+        float coeff = roundf(2 * cosf(2 * M_PI * freqs[i]) * (1 << 14));
+        if (coeff > INT16_MAX) coeff = INT16_MAX;
+        goertzel->coeffs[i] = (int16_t)coeff;
+    }
+    for (int i = 0 ; i < bins * 2 ; i++) {
+        goertzel->delay[i] = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_goertzel_power_s16(dsps_goertzel_s16_t *goertzel, float *power)
+{
+    for (int i = 0 ; i < goertzel->bins ; i++) {
+        float s1 = goertzel->delay[i * 2 + 0];
+        float s2 = goertzel->delay[i * 2 + 1];
+        float coeff = (float)goertzel->coeffs[i] / (1 << 14);
+        power[i] = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        goertzel->delay[i * 2 + 0] = 0;
+        goertzel->delay[i * 2 + 1] = 0;
+    }
+    return ESP_OK;
+}
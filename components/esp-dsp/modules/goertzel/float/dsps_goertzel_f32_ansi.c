@@ -0,0 +1,32 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dsps_goertzel.h"
+
+
+esp_err_t dsps_goertzel_f32_ansi(dsps_goertzel_f32_t *goertzel, const float *input, int len, int step)
+{
+    if (NULL == input) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+
+    for (int i = 0 ; i < len ; i++) {
+        float x = input[i * step];
+        for (int b = 0 ; b < goertzel->bins ; b++) {
+            float *w = &goertzel->delay[b * 2];
+            float s = x + goertzel->coeffs[b] * w[0] - w[1];
+            w[1] = w[0];
+            w[0] = s;
+        }
+    }
+    return ESP_OK;
+}
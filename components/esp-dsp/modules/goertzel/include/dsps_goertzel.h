@@ -0,0 +1,143 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _dsps_goertzel_H_
+#define _dsps_goertzel_H_
+
+#include "dsp_err.h"
+
+#include "dsps_goertzel_platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Data struct of f32 Goertzel filter bank
+ *
+ * This structure used by filter bank internally. User should access this structure only in case of
+ * extensions for the DSP Library.
+ * All fields of this structure initialized by dsps_goertzel_init_f32(...) function.
+ */
+typedef struct dsps_goertzel_f32_s {
+    float  *coeffs;     /*!< Pointer to the coefficient buffer, 2*cos(2*pi*f) for every bin.*/
+    float  *delay;      /*!< Pointer to the delay line buffer, two values for every bin.*/
+    int     bins;       /*!< Amount of frequency bins.*/
+} dsps_goertzel_f32_t;
+
+/**
+ * @brief Data struct of s16 Goertzel filter bank
+ *
+ * This structure used by filter bank internally. User should access this structure only in case of
+ * extensions for the DSP Library.
+ * All fields of this structure initialized by dsps_goertzel_init_s16(...) function.
+ */
+typedef struct dsps_goertzel_s16_s {
+    int16_t *coeffs;    /*!< Pointer to the coefficient buffer, 2*cos(2*pi*f) in Q14 format for every bin.*/
+    int32_t *delay;     /*!< Pointer to the delay line buffer, two values for every bin.*/
+    int      bins;      /*!< Amount of frequency bins.*/
+} dsps_goertzel_s16_t;
+
+/**@{*/
+/**
+ * @brief   initialize structure for Goertzel filter bank
+ *
+ * Function calculates coefficients for the given frequencies and clears the delay line.
+ * The implementation use ANSI C and could be compiled and run on any platform
+ *
+ * @param goertzel: pointer to filter bank structure, that must be preallocated
+ * @param coeffs: array for coefficients. Must be length bins
+ * @param delay: array for delay line. Must be length 2*bins
+ * @param freqs: normalized frequencies of the bins (frequency/sample rate), in range [0..0.5]
+ * @param bins: amount of frequency bins
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - One of the error codes from DSP library
+ */
+esp_err_t dsps_goertzel_init_f32(dsps_goertzel_f32_t *goertzel, float *coeffs, float *delay, const float *freqs, int bins);
+esp_err_t dsps_goertzel_init_s16(dsps_goertzel_s16_t *goertzel, int16_t *coeffs, int32_t *delay, const float *freqs, int bins);
+/**@}*/
+
+/**@{*/
+/**
+ * @brief   Goertzel filter bank
+ *
+ * Function feeds input samples to all bins of the filter bank in a single pass over the input.
+ * It could be called several times to process a block of data in parts.
+ * The extension (_ansi) use ANSI C and could be compiled and run on any platform.
+ * The extension (_ae32) is optimized for ESP32 chip.
+ *
+ * For s16 version the delay line is 32 bit wide and the products are computed without overflow
+ * while absolute values of the delay line are below 2^30, which limits the block length for
+ * inputs close to full scale.
+ *
+ * @param goertzel: pointer to filter bank structure
+ * @param input: input array
+ * @param len: amount of samples to process
+ * @param step: step over input array (by default should be 1), allows to process one channel of interleaved data
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - One of the error codes from DSP library
+ */
+esp_err_t dsps_goertzel_f32_ansi(dsps_goertzel_f32_t *goertzel, const float *input, int len, int step);
+esp_err_t dsps_goertzel_f32_ae32(dsps_goertzel_f32_t *goertzel, const float *input, int len, int step);
+esp_err_t dsps_goertzel_s16_ansi(dsps_goertzel_s16_t *goertzel, const int16_t *input, int len, int step);
+esp_err_t dsps_goertzel_s16_ae32(dsps_goertzel_s16_t *goertzel, const int16_t *input, int len, int step);
+/**@}*/
+
+/**@{*/
+/**
+ * @brief   power of the Goertzel filter bank bins
+ *
+ * Function calculates squared magnitude of the DFT at every bin frequency for the samples processed
+ * since initialization or the previous call, and clears the delay line for the next block.
+ * The implementation use ANSI C and could be compiled and run on any platform
+ *
+ * @param goertzel: pointer to filter bank structure
+ * @param power: output array. Must be length bins
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - One of the error codes from DSP library
+ */
+esp_err_t dsps_goertzel_power_f32(dsps_goertzel_f32_t *goertzel, float *power);
+esp_err_t dsps_goertzel_power_s16(dsps_goertzel_s16_t *goertzel, float *power);
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#if CONFIG_DSP_OPTIMIZED
+#if (dsps_goertzel_f32_ae32_enabled == 1)
+#define dsps_goertzel_f32 dsps_goertzel_f32_ae32
+#else
+#define dsps_goertzel_f32 dsps_goertzel_f32_ansi
+#endif
+#if (dsps_goertzel_s16_ae32_enabled == 1)
+#define dsps_goertzel_s16 dsps_goertzel_s16_ae32
+#else
+#define dsps_goertzel_s16 dsps_goertzel_s16_ansi
+#endif
+#else // CONFIG_DSP_OPTIMIZED
+#define dsps_goertzel_f32 dsps_goertzel_f32_ansi
+#define dsps_goertzel_s16 dsps_goertzel_s16_ansi
+#endif // CONFIG_DSP_OPTIMIZED
+
+
+#endif // _dsps_goertzel_H_
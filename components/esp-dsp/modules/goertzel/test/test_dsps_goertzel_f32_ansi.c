@@ -0,0 +1,94 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+#include <math.h>
+#include "unity.h"
+#include "dsp_platform.h"
+#include "esp_log.h"
+
+#include "dsps_tone_gen.h"
+#include "dsps_goertzel.h"
+#include "dsp_tests.h"
+
+static const char *TAG = "dsps_goertzel_f32_ansi";
+
+static float x[256];
+
+static const float freqs[4] = {0.05, 0.1, 0.2, 0.45};
+static float coeffs[4];
+static float delay[8];
+static float power[4];
+
+TEST_CASE("dsps_goertzel_f32_ansi functionality", "[dsps]")
+{
+    int len = sizeof(x) / sizeof(float);
+    int bins = sizeof(freqs) / sizeof(float);
+
+    dsps_tone_gen_f32(x, len, 100, 0.1, 30);
+    for (int i = 0 ; i < len ; i++) {
+        x[i] += 10 * sinf(2 * M_PI * 0.45 * i);
+    }
+
+    dsps_goertzel_f32_t goertzel;
+    TEST_ASSERT_EQUAL(ESP_OK, dsps_goertzel_init_f32(&goertzel, coeffs, delay, freqs, bins));
+    // process the block in two parts, result must be the same as for the whole block
+    dsps_goertzel_f32_ansi(&goertzel, x, len / 2, 1);
+    dsps_goertzel_f32_ansi(&goertzel, x + len / 2, len - len / 2, 1);
+    dsps_goertzel_power_f32(&goertzel, power);
+
+    for (int b = 0 ; b < bins ; b++) {
+        // reference: squared magnitude of the DFT at the bin frequency
+        float re = 0;
+        float im = 0;
+        for (int i = 0 ; i < len ; i++) {
+            re += x[i] * cosf(2 * M_PI * freqs[b] * i);
+            im -= x[i] * sinf(2 * M_PI * freqs[b] * i);
+        }
+        float expected = re * re + im * im;
+        ESP_LOGD(TAG, "bin %i: power %f, expected %f", b, power[b], expected);
+        TEST_ASSERT_FLOAT_WITHIN(expected * 0.001 + 1, expected, power[b]);
+    }
+    // delay line is cleared after power is calculated
+    for (int i = 0 ; i < bins * 2 ; i++) {
+        TEST_ASSERT_EQUAL(0, delay[i]);
+    }
+}
+
+TEST_CASE("dsps_goertzel_f32_ansi benchmark", "[dsps]")
+{
+    int len = sizeof(x) / sizeof(float);
+    int bins = sizeof(freqs) / sizeof(float);
+    int repeat_count = 1;
+
+    dsps_tone_gen_f32(x, len, 1, 0.1, 0);
+    dsps_goertzel_f32_t goertzel;
+    dsps_goertzel_init_f32(&goertzel, coeffs, delay, freqs, bins);
+
+    unsigned int start_b = xthal_get_ccount();
+    for (int i = 0 ; i < repeat_count ; i++) {
+        dsps_goertzel_f32_ansi(&goertzel, x, len, 1);
+    }
+    unsigned int end_b = xthal_get_ccount();
+
+    float total_b = end_b - start_b;
+    float cycles = total_b / (len * repeat_count);
+
+    ESP_LOGI(TAG, "dsps_goertzel_f32_ansi - %f per sample for %i bins, %f per bin \n", cycles, bins, cycles / (float)bins);
+
+    float min_exec = 10;
+    float max_exec = 800;
+    TEST_ASSERT_EXEC_IN_RANGE(min_exec, max_exec, cycles);
+}
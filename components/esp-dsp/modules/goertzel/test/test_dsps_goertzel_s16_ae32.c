@@ -0,0 +1,87 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+#include <math.h>
+#include "unity.h"
+#include "dsp_platform.h"
+#include "esp_log.h"
+
+#include "dsps_goertzel.h"
+#include "dsp_tests.h"
+
+static const char *TAG = "dsps_goertzel_s16_ae32";
+
+// three interleaved channels, as frames of the accelerometer
+static int16_t x[256 * 3];
+
+static const float freqs[4] = {0.02, 0.05, 0.1, 0.45};
+static int16_t coeffs[4];
+static int32_t delay[8];
+static int32_t delay_compare[8];
+
+TEST_CASE("dsps_goertzel_s16_ae32 functionality", "[dsps]")
+{
+    int len = sizeof(x) / sizeof(int16_t) / 3;
+    int bins = sizeof(freqs) / sizeof(float);
+
+    for (int i = 0 ; i < len ; i++) {
+        x[i * 3 + 0] = (int16_t)(-16000 * cosf(2 * M_PI * 0.05 * i));
+        x[i * 3 + 1] = (int16_t)(500 * sinf(2 * M_PI * 0.1 * i) - 1000);
+        x[i * 3 + 2] = (int16_t)((i % 16) * 1000 - 8000);
+    }
+
+    dsps_goertzel_s16_t goertzel1;
+    dsps_goertzel_s16_t goertzel2;
+    dsps_goertzel_init_s16(&goertzel1, coeffs, delay, freqs, bins);
+    dsps_goertzel_init_s16(&goertzel2, coeffs, delay_compare, freqs, bins);
+
+    for (int channel = 0 ; channel < 3 ; channel++) {
+        dsps_goertzel_s16_ae32(&goertzel1, x + channel, len, 3);
+        dsps_goertzel_s16_ansi(&goertzel2, x + channel, len, 3);
+        // results must be bit exact, including negative delay line values
+        for (int i = 0 ; i < bins * 2 ; i++) {
+            TEST_ASSERT_EQUAL(delay_compare[i], delay[i]);
+        }
+    }
+}
+
+TEST_CASE("dsps_goertzel_s16_ae32 benchmark", "[dsps]")
+{
+    int len = sizeof(x) / sizeof(int16_t) / 3;
+    int bins = sizeof(freqs) / sizeof(float);
+    int repeat_count = 1;
+
+    for (int i = 0 ; i < len * 3 ; i++) {
+        x[i] = i << 4;
+    }
+    dsps_goertzel_s16_t goertzel;
+    dsps_goertzel_init_s16(&goertzel, coeffs, delay, freqs, bins);
+
+    unsigned int start_b = xthal_get_ccount();
+    for (int i = 0 ; i < repeat_count ; i++) {
+        dsps_goertzel_s16_ae32(&goertzel, x, len, 3);
+    }
+    unsigned int end_b = xthal_get_ccount();
+
+    float total_b = end_b - start_b;
+    float cycles = total_b / (len * repeat_count);
+
+    ESP_LOGI(TAG, "dsps_goertzel_s16_ae32 - %f per sample for %i bins, %f per bin \n", cycles, bins, cycles / (float)bins);
+
+    float min_exec = 3;
+    float max_exec = 800;
+    TEST_ASSERT_EXEC_IN_RANGE(min_exec, max_exec, cycles);
+}
@@ -0,0 +1,94 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+#include <math.h>
+#include "unity.h"
+#include "dsp_platform.h"
+#include "esp_log.h"
+
+#include "dsps_goertzel.h"
+#include "dsp_tests.h"
+
+static const char *TAG = "dsps_goertzel_s16_ansi";
+
+// three interleaved channels, as frames of the accelerometer
+static int16_t x[256 * 3];
+static float x_f32[256];
+
+static const float freqs[4] = {0.05, 0.1, 0.2, 0.45};
+static int16_t coeffs[4];
+static int32_t delay[8];
+static float coeffs_f32[4];
+static float delay_f32[8];
+static float power[4];
+static float power_compare[4];
+
+TEST_CASE("dsps_goertzel_s16_ansi functionality", "[dsps]")
+{
+    int len = sizeof(x_f32) / sizeof(float);
+    int bins = sizeof(freqs) / sizeof(float);
+
+    for (int i = 0 ; i < len ; i++) {
+        x[i * 3 + 0] = 1000;
+        x[i * 3 + 1] = (int16_t)(500 * sinf(2 * M_PI * 0.1 * i) + 50 * sinf(2 * M_PI * 0.45 * i));
+        x[i * 3 + 2] = -1000;
+        x_f32[i] = x[i * 3 + 1];
+    }
+
+    dsps_goertzel_s16_t goertzel;
+    dsps_goertzel_f32_t goertzel_f32;
+    TEST_ASSERT_EQUAL(ESP_OK, dsps_goertzel_init_s16(&goertzel, coeffs, delay, freqs, bins));
+    dsps_goertzel_init_f32(&goertzel_f32, coeffs_f32, delay_f32, freqs, bins);
+
+    dsps_goertzel_s16_ansi(&goertzel, x + 1, len, 3);
+    dsps_goertzel_f32_ansi(&goertzel_f32, x_f32, len, 1);
+    dsps_goertzel_power_s16(&goertzel, power);
+    dsps_goertzel_power_f32(&goertzel_f32, power_compare);
+
+    for (int b = 0 ; b < bins ; b++) {
+        ESP_LOGD(TAG, "bin %i: power %f, f32 power %f", b, power[b], power_compare[b]);
+        // error of the power is dominated by the Q14 coefficients, it must stay within 1% of the full scale
+        TEST_ASSERT_FLOAT_WITHIN(power_compare[1] * 0.01, power_compare[b], power[b]);
+    }
+}
+
+TEST_CASE("dsps_goertzel_s16_ansi benchmark", "[dsps]")
+{
+    int len = sizeof(x_f32) / sizeof(float);
+    int bins = sizeof(freqs) / sizeof(float);
+    int repeat_count = 1;
+
+    for (int i = 0 ; i < len * 3 ; i++) {
+        x[i] = i << 4;
+    }
+    dsps_goertzel_s16_t goertzel;
+    dsps_goertzel_init_s16(&goertzel, coeffs, delay, freqs, bins);
+
+    unsigned int start_b = xthal_get_ccount();
+    for (int i = 0 ; i < repeat_count ; i++) {
+        dsps_goertzel_s16_ansi(&goertzel, x, len, 3);
+    }
+    unsigned int end_b = xthal_get_ccount();
+
+    float total_b = end_b - start_b;
+    float cycles = total_b / (len * repeat_count);
+
+    ESP_LOGI(TAG, "dsps_goertzel_s16_ansi - %f per sample for %i bins, %f per bin \n", cycles, bins, cycles / (float)bins);
+
+    float min_exec = 10;
+    float max_exec = 800;
+    TEST_ASSERT_EXEC_IN_RANGE(min_exec, max_exec, cycles);
+}
@@ -0,0 +1,36 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "dsps_unpack.h"
+
+
+esp_err_t dsps_unpack3_be16_s16_ansi(const uint8_t *input, int16_t *out0, int16_t *out1, int16_t *out2, int len, int step_out, int16_t scale, int shift)
+{
+    if (NULL == input) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+    if (NULL == out0) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+    if (NULL == out1) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+    if (NULL == out2) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+
+    for (int i = 0 ; i < len ; i++) {
+        int32_t x0 = (int16_t)((input[0] << 8) | input[1]);
+        int32_t x1 = (int16_t)((input[2] << 8) | input[3]);
+        int32_t x2 = (int16_t)((input[4] << 8) | input[5]);
+        input += 6;
+        out0[i * step_out] = (x0 * scale) >> shift;
+        out1[i * step_out] = (x1 * scale) >> shift;
+        out2[i * step_out] = (x2 * scale) >> shift;
+    }
+    return ESP_OK;
+}
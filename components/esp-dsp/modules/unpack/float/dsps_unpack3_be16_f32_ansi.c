@@ -0,0 +1,33 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "dsps_unpack.h"
+
+
+esp_err_t dsps_unpack3_be16_f32_ansi(const uint8_t *input, float *out0, float *out1, float *out2, int len, float scale)
+{
+    if (NULL == input) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+    if (NULL == out0) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+    if (NULL == out1) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+    if (NULL == out2) return ESP_ERR_DSP_PARAM_OUTOFRANGE;
+
+    for (int i = 0 ; i < len ; i++) {
+        out0[i] = (int16_t)((input[0] << 8) | input[1]) * scale;
+        out1[i] = (int16_t)((input[2] << 8) | input[3]) * scale;
+        out2[i] = (int16_t)((input[4] << 8) | input[5]) * scale;
+        input += 6;
+    }
+    return ESP_OK;
+}
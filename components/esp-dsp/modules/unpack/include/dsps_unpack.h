@@ -0,0 +1,103 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _dsps_unpack_H_
+#define _dsps_unpack_H_
+
+#include "dsp_err.h"
+
+#include "dsps_unpack_platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**@{*/
+/**
+ * @brief   Deinterleave and scale three channels of big-endian 16 bit samples
+ *
+ * Function unpacks frames of three interleaved big-endian signed 16 bit values (as a sensor FIFO
+ * delivers them) into three output arrays in a single pass, scaling every sample:
+ * out0[i*step_out] = (input0[i]*scale) >> shift, where input0[i] is the first value of frame i.
+ * Arithmetic shift is used, so negative results are rounded toward minus infinity.
+ * Every frame is read completely before its results are stored, so with step_out = 3 the output
+ * could overlap the input frame by frame, which converts the data in place.
+ * The extension (_ansi) use ANSI C and could be compiled and run on any platform.
+ * The extension (_ae32) is optimized for ESP32 chip.
+ *
+ * @param input: input array of 6*len bytes
+ * @param out0: output array for the first channel
+ * @param out1: output array for the second channel
+ * @param out2: output array for the third channel
+ * @param len: amount of frames
+ * @param step_out: step over output arrays (by default should be 1)
+ * @param scale: multiplier of the samples
+ * @param shift: right shift of the products, in range [0..31]
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - One of the error codes from DSP library
+ */
+esp_err_t dsps_unpack3_be16_s16_ansi(const uint8_t *input, int16_t *out0, int16_t *out1, int16_t *out2, int len, int step_out, int16_t scale, int shift);
+esp_err_t dsps_unpack3_be16_s16_ae32(const uint8_t *input, int16_t *out0, int16_t *out1, int16_t *out2, int len, int step_out, int16_t scale, int shift);
+/**@}*/
+
+/**@{*/
+/**
+ * @brief   Deinterleave and scale three channels of big-endian 16 bit samples to float
+ *
+ * Function unpacks frames of three interleaved big-endian signed 16 bit values into three
+ * float arrays in a single pass: out0[i] = input0[i]*scale.
+ * The extension (_ansi) use ANSI C and could be compiled and run on any platform.
+ * The extension (_ae32) is optimized for ESP32 chip.
+ *
+ * @param input: input array of 6*len bytes
+ * @param out0: output array for the first channel
+ * @param out1: output array for the second channel
+ * @param out2: output array for the third channel
+ * @param len: amount of frames
+ * @param scale: multiplier of the samples
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - One of the error codes from DSP library
+ */
+esp_err_t dsps_unpack3_be16_f32_ansi(const uint8_t *input, float *out0, float *out1, float *out2, int len, float scale);
+esp_err_t dsps_unpack3_be16_f32_ae32(const uint8_t *input, float *out0, float *out1, float *out2, int len, float scale);
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#if CONFIG_DSP_OPTIMIZED
+#if (dsps_unpack3_be16_s16_ae32_enabled == 1)
+#define dsps_unpack3_be16_s16 dsps_unpack3_be16_s16_ae32
+#else
+#define dsps_unpack3_be16_s16 dsps_unpack3_be16_s16_ansi
+#endif
+#if (dsps_unpack3_be16_f32_ae32_enabled == 1)
+#define dsps_unpack3_be16_f32 dsps_unpack3_be16_f32_ae32
+#else
+#define dsps_unpack3_be16_f32 dsps_unpack3_be16_f32_ansi
+#endif
+#else // CONFIG_DSP_OPTIMIZED
+#define dsps_unpack3_be16_s16 dsps_unpack3_be16_s16_ansi
+#define dsps_unpack3_be16_f32 dsps_unpack3_be16_f32_ansi
+#endif // CONFIG_DSP_OPTIMIZED
+
+
+#endif // _dsps_unpack_H_
@@ -0,0 +1,76 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include <string.h>
+#include "unity.h"
+#include "dsp_platform.h"
+#include "esp_log.h"
+
+#include "dsps_unpack.h"
+#include "dsp_tests.h"
+
+static const char *TAG = "dsps_unpack3_be16_f32_ansi";
+
+// big-endian frames of three channels, as in the FIFO of the accelerometer
+static uint8_t frames[170 * 6];
+static float out0[170];
+static float out1[170];
+static float out2[170];
+
+static void fill_frames(int len)
+{
+    for (int i = 0 ; i < len * 3 ; i++) {
+        int16_t value = (int16_t)(i * 397 - 32768);
+        frames[i * 2] = (uint16_t)value >> 8;
+        frames[i * 2 + 1] = value & 0xff;
+    }
+}
+
+TEST_CASE("dsps_unpack3_be16_f32_ansi functionality", "[dsps]")
+{
+    int len = sizeof(out0) / sizeof(float);
+    fill_frames(len);
+
+    float scale = 16000.0 / 32768;
+    dsps_unpack3_be16_f32_ansi(frames, out0, out1, out2, len, scale);
+    for (int i = 0 ; i < len ; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(1e-3, (int16_t)((i * 3 + 0) * 397 - 32768) * scale, out0[i]);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3, (int16_t)((i * 3 + 1) * 397 - 32768) * scale, out1[i]);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3, (int16_t)((i * 3 + 2) * 397 - 32768) * scale, out2[i]);
+    }
+}
+
+TEST_CASE("dsps_unpack3_be16_f32_ansi benchmark", "[dsps]")
+{
+    int len = sizeof(out0) / sizeof(float);
+    int repeat_count = 1;
+    fill_frames(len);
+
+    unsigned int start_b = xthal_get_ccount();
+    for (int i = 0 ; i < repeat_count ; i++) {
+        dsps_unpack3_be16_f32_ansi(frames, out0, out1, out2, len, 0.5);
+    }
+    unsigned int end_b = xthal_get_ccount();
+
+    float total_b = end_b - start_b;
+    float cycles = total_b / (len * repeat_count);
+
+    ESP_LOGI(TAG, "dsps_unpack3_be16_f32_ansi - %f per frame \n", cycles);
+
+    float min_exec = 10;
+    float max_exec = 200;
+    TEST_ASSERT_EXEC_IN_RANGE(min_exec, max_exec, cycles);
+}
@@ -0,0 +1,89 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include <string.h>
+#include "unity.h"
+#include "dsp_platform.h"
+#include "esp_log.h"
+
+#include "dsps_unpack.h"
+#include "dsp_tests.h"
+
+static const char *TAG = "dsps_unpack3_be16_s16_ae32";
+
+// big-endian frames of three channels, as in the FIFO of the accelerometer
+static uint8_t frames[170 * 6];
+static int16_t in_place[170 * 3];
+static int16_t out0[170];
+static int16_t out1[170];
+static int16_t out2[170];
+static int16_t out_compare[170 * 3];
+
+static void fill_frames(int len)
+{
+    for (int i = 0 ; i < len * 3 ; i++) {
+        int16_t value = (int16_t)(i * 397 - 32768);
+        frames[i * 2] = (uint16_t)value >> 8;
+        frames[i * 2 + 1] = value & 0xff;
+    }
+}
+
+TEST_CASE("dsps_unpack3_be16_s16_ae32 functionality", "[dsps]")
+{
+    int len = sizeof(out0) / sizeof(int16_t);
+    fill_frames(len);
+
+    // negative scale checks sign extension of the argument
+    const int16_t scales[3] = {125, -3, INT16_MAX};
+    const int shifts[3] = {8, 0, 15};
+    for (int s = 0 ; s < 3 ; s++) {
+        dsps_unpack3_be16_s16_ae32(frames, out0, out1, out2, len, 1, scales[s], shifts[s]);
+        dsps_unpack3_be16_s16_ansi(frames, out_compare, out_compare + 1, out_compare + 2, len, 3, scales[s], shifts[s]);
+        for (int i = 0 ; i < len ; i++) {
+            TEST_ASSERT_EQUAL(out_compare[i * 3 + 0], out0[i]);
+            TEST_ASSERT_EQUAL(out_compare[i * 3 + 1], out1[i]);
+            TEST_ASSERT_EQUAL(out_compare[i * 3 + 2], out2[i]);
+        }
+
+        memcpy(in_place, frames, sizeof(frames));
+        dsps_unpack3_be16_s16_ae32((uint8_t *)in_place, in_place, in_place + 1, in_place + 2, len, 3, scales[s], shifts[s]);
+        for (int i = 0 ; i < len * 3 ; i++) {
+            TEST_ASSERT_EQUAL(out_compare[i], in_place[i]);
+        }
+    }
+}
+
+TEST_CASE("dsps_unpack3_be16_s16_ae32 benchmark", "[dsps]")
+{
+    int len = sizeof(out0) / sizeof(int16_t);
+    int repeat_count = 1;
+    fill_frames(len);
+
+    unsigned int start_b = xthal_get_ccount();
+    for (int i = 0 ; i < repeat_count ; i++) {
+        dsps_unpack3_be16_s16_ae32(frames, out0, out1, out2, len, 1, 125, 8);
+    }
+    unsigned int end_b = xthal_get_ccount();
+
+    float total_b = end_b - start_b;
+    float cycles = total_b / (len * repeat_count);
+
+    ESP_LOGI(TAG, "dsps_unpack3_be16_s16_ae32 - %f per frame \n", cycles);
+
+    float min_exec = 10;
+    float max_exec = 100;
+    TEST_ASSERT_EXEC_IN_RANGE(min_exec, max_exec, cycles);
+}
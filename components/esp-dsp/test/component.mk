@@ -3,6 +3,8 @@ COMPONENT_SRCDIRS := \
 					../modules/dotprod/test \
 					../modules/matrix/test \
 					../modules/iir/test \
+					../modules/goertzel/test \
+					../modules/unpack/test \
 					../modules/fir/test \
 					../modules/math/mulc/test \
 					../modules/math/addc/test \
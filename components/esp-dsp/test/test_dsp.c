@@ -86,6 +86,17 @@ TEST_CASE("DSP Libary benchmark table", "[dsp]")
     float coeffs[5];
     dsps_biquad_gen_lpf_f32(coeffs, 0.1, 1);
 
+    const float goertzel_freqs[4] = {0.01, 0.05, 0.1, 0.2};
+    float goertzel_coeffs_f32[4];
+    float goertzel_delay_f32[8];
+    dsps_goertzel_f32_t goertzel_f32;
+    dsps_goertzel_init_f32(&goertzel_f32, goertzel_coeffs_f32, goertzel_delay_f32, goertzel_freqs, 4);
+
+    int16_t goertzel_coeffs_s16[4];
+    int32_t goertzel_delay_s16[8];
+    dsps_goertzel_s16_t goertzel_s16;
+    dsps_goertzel_init_s16(&goertzel_s16, goertzel_coeffs_s16, goertzel_delay_s16, goertzel_freqs, 4);
+
 #if CONFIG_IDF_TARGET_ESP32
     REPORT_HEADER_ESP32();
 #elif CONFIG_IDF_TARGET_ESP32S3
@@ -198,6 +209,30 @@ TEST_CASE("DSP Libary benchmark table", "[dsp]")
                      dsps_biquad_f32_ansi,
                      data1, data2, 1024, coeffs, data3);
 
+    REPORT_SECTION("**Goertzel Filter Bank**");
+
+    REPORT_BENCHMARK("dsps_goertzel_f32 for 1024 samples and 4 bins",
+                     dsps_goertzel_f32,
+                     dsps_goertzel_f32_ansi,
+                     &goertzel_f32, data1, 1024, 1);
+
+    REPORT_BENCHMARK("dsps_goertzel_s16 for 1024 samples and 4 bins, with step 3",
+                     dsps_goertzel_s16,
+                     dsps_goertzel_s16_ansi,
+                     &goertzel_s16, (int16_t *)data1, 1024, 3);
+
+    REPORT_SECTION("**Unpack**");
+
+    REPORT_BENCHMARK("dsps_unpack3_be16_s16 for 170 frames of three big-endian channels",
+                     dsps_unpack3_be16_s16,
+                     dsps_unpack3_be16_s16_ansi,
+                     (uint8_t *)data1, (int16_t *)data2, (int16_t *)data2 + 170, (int16_t *)data2 + 340, 170, 1, 125, 8);
+
+    REPORT_BENCHMARK("dsps_unpack3_be16_f32 for 170 frames of three big-endian channels",
+                     dsps_unpack3_be16_f32,
+                     dsps_unpack3_be16_f32_ansi,
+                     (uint8_t *)data1, data2, data2 + 170, data2 + 340, 170, 0.488281f);
+
     REPORT_SECTION("**Matrix Multiplication**");
 
     REPORT_BENCHMARK("dspm_mult_f32 - C[16,16] = A[16,16]*B[16,16];",
@@ -15,10 +15,29 @@
 #include <esp_err.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_idf_version.h>
 #include "esp32_i2c_rw/esp32_i2c_rw.h"
 
 #define I2C_NUM (I2C_NUM_0)
 
+// long enough for the whole FIFO of a sensor at 100 kHz
+#define I2C_WRITE_READ_TIMEOUT_MS 200
+
+// reads and writes in a write-read, as counted by I2C_LINK_RECOMMENDED_SIZE()
+#define I2C_WRITE_READ_TRANSACTIONS 3
+
+typedef struct {
+	uint8_t device_address;
+	uint8_t register_address;
+	size_t size;
+	uint8_t* data;
+	esp32_i2c_done_cb_t done;
+	void* arg;
+} i2c_transaction_t;
+
+static QueueHandle_t transaction_queue;
+
 void select_register(uint8_t device_address, uint8_t register_address)
 {
 	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
@@ -30,7 +49,7 @@ void select_register(uint8_t device_address, uint8_t register_address)
 	i2c_cmd_link_delete(cmd);
 }
 
-int8_t esp32_i2c_read_bytes
+esp_err_t esp32_i2c_write_read
 (
 	uint8_t device_address,
 	uint8_t register_address,
@@ -38,19 +57,122 @@ int8_t esp32_i2c_read_bytes
 	uint8_t* data
 )
 {
-	select_register(device_address, register_address);
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (device_address << 1) | I2C_MASTER_READ, 1);
+	if (size == 0 || data == NULL)
+		return (ESP_ERR_INVALID_ARG);
 
-	if (size > 1)
-		i2c_master_read(cmd, data, size - 1, 0);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+	uint8_t link[I2C_LINK_RECOMMENDED_SIZE(I2C_WRITE_READ_TRANSACTIONS)];
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
+#else
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+#endif
+	if (cmd == NULL)
+		return (ESP_ERR_NO_MEM);
 
-	i2c_master_read_byte(cmd, data + size - 1, 1);
+	esp_err_t ret = i2c_master_start(cmd);
+	if (ret == ESP_OK)
+		ret = i2c_master_write_byte(cmd, (device_address << 1) | I2C_MASTER_WRITE, 1);
+	if (ret == ESP_OK)
+		ret = i2c_master_write_byte(cmd, register_address, 1);
+	if (ret == ESP_OK)
+		ret = i2c_master_start(cmd);
+	if (ret == ESP_OK)
+		ret = i2c_master_write_byte(cmd, (device_address << 1) | I2C_MASTER_READ, 1);
+	if (ret == ESP_OK)
+		ret = i2c_master_read(cmd, data, size, I2C_MASTER_LAST_NACK);
+	if (ret == ESP_OK)
+		ret = i2c_master_stop(cmd);
+	if (ret == ESP_OK)
+		ret = i2c_master_cmd_begin(I2C_NUM, cmd, I2C_WRITE_READ_TIMEOUT_MS / portTICK_PERIOD_MS);
 
-	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 1000 / portTICK_PERIOD_MS);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+	i2c_cmd_link_delete_static(cmd);
+#else
 	i2c_cmd_link_delete(cmd);
+#endif
+
+	return (ret);
+}
+
+static void i2c_async_task(void* args)
+{
+	i2c_transaction_t transaction;
+
+	while (1) {
+		xQueueReceive(transaction_queue, &transaction, portMAX_DELAY);
+		esp_err_t ret = esp32_i2c_write_read
+		(
+			transaction.device_address,
+			transaction.register_address,
+			transaction.size,
+			transaction.data
+		);
+
+		if (transaction.done != NULL)
+			transaction.done(ret, transaction.arg);
+	}
+}
+
+esp_err_t esp32_i2c_async_init(size_t queue_length, UBaseType_t priority)
+{
+	if (transaction_queue != NULL)
+		return (ESP_ERR_INVALID_STATE);
+
+	QueueHandle_t queue = xQueueCreate(queue_length, sizeof(i2c_transaction_t));
+	if (queue == NULL)
+		return (ESP_ERR_NO_MEM);
+
+	transaction_queue = queue;
+	if (xTaskCreate(i2c_async_task, "i2c_async", 3 * configMINIMAL_STACK_SIZE, NULL, priority, NULL) != pdPASS) {
+		transaction_queue = NULL;
+		vQueueDelete(queue);
+		return (ESP_ERR_NO_MEM);
+	}
+
+	return (ESP_OK);
+}
+
+esp_err_t esp32_i2c_write_read_async
+(
+	uint8_t device_address,
+	uint8_t register_address,
+	size_t size,
+	uint8_t* data,
+	esp32_i2c_done_cb_t done,
+	void* arg
+)
+{
+	if (transaction_queue == NULL)
+		return (ESP_ERR_INVALID_STATE);
+
+	if (size == 0 || data == NULL)
+		return (ESP_ERR_INVALID_ARG);
+
+	i2c_transaction_t transaction = {
+		.device_address = device_address,
+		.register_address = register_address,
+		.size = size,
+		.data = data,
+		.done = done,
+		.arg = arg
+	};
+
+	if (xQueueSend(transaction_queue, &transaction, 0) != pdTRUE)
+		return (ESP_ERR_NO_MEM);
+
+	return (ESP_OK);
+}
+
+int8_t esp32_i2c_read_bytes
+(
+	uint8_t device_address,
+	uint8_t register_address,
+	size_t size,
+	uint8_t* data
+)
+{
+	if (esp32_i2c_write_read(device_address, register_address, size, data) != ESP_OK)
+		return (0);
 
 	return (size);
 }
@@ -119,10 +241,10 @@ bool esp32_i2c_write_bytes
 	i2c_master_write(cmd, data, size - 1, 0);
 	i2c_master_write_byte(cmd, data [size - 1], 1);
 	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 1000 / portTICK_PERIOD_MS);
+	esp_err_t ret = i2c_master_cmd_begin(I2C_NUM, cmd, 1000 / portTICK_PERIOD_MS);
 	i2c_cmd_link_delete(cmd);
 
-	return (true);
+	return (ret == ESP_OK);
 }
 
 bool esp32_i2c_write_byte
@@ -138,10 +260,10 @@ bool esp32_i2c_write_byte
 	i2c_master_write_byte(cmd, register_address, 1);
 	i2c_master_write_byte(cmd, data, 1);
 	i2c_master_stop(cmd);
-	i2c_master_cmd_begin(I2C_NUM, cmd, 1000 / portTICK_PERIOD_MS);
+	esp_err_t ret = i2c_master_cmd_begin(I2C_NUM, cmd, 1000 / portTICK_PERIOD_MS);
 	i2c_cmd_link_delete(cmd);
 
-	return (true);
+	return (ret == ESP_OK);
 }
 
 bool esp32_i2c_write_bits
@@ -15,6 +15,7 @@
 #define ESP32_I2C_RW_H
 
 #include <driver/i2c.h>
+#include <esp_err.h>
 
 /**
  * @brief Select the register in the device where data will be read from.
@@ -24,6 +25,74 @@
  */
 void select_register(uint8_t device_address, uint8_t register_address);
 
+/**
+ * @brief Read multiple bytes from 8-bit registers in one transaction.
+ * Register is selected and read after a repeated start, so nothing else can
+ * get between them and there is no second STOP and address phase.
+ * Command link is built in a buffer on the stack, without heap allocations,
+ * when the driver supports it.
+ *
+ * @param device_address I2C slave device address.
+ * @param register_address Address of the first register to read from.
+ * @param size Number of registers to read, at least 1.
+ * @param data Buffer to store the read data in.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or error of the I2C driver
+ * (ESP_FAIL when the device did not acknowledge, ESP_ERR_TIMEOUT when the bus is busy).
+ */
+esp_err_t esp32_i2c_write_read
+(
+    uint8_t device_address,
+    uint8_t register_address,
+    size_t size,
+    uint8_t* data
+);
+
+/**
+ * @brief Called from the I2C task once a queued transaction completes.
+ *
+ * @param result Status of the transaction, as of esp32_i2c_write_read().
+ * @param arg Argument passed when the transaction was queued.
+ */
+typedef void (*esp32_i2c_done_cb_t)(esp_err_t result, void* arg);
+
+/**
+ * @brief Start the task that runs queued transactions, one at a time.
+ * Call once, after the I2C driver is installed.
+ *
+ * @param queue_length Number of transactions that can wait at once.
+ * @param priority Priority of the task, higher than of the tasks queueing
+ * transactions to start them as soon as they are queued.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if already started or ESP_ERR_NO_MEM.
+ */
+esp_err_t esp32_i2c_async_init(size_t queue_length, UBaseType_t priority);
+
+/**
+ * @brief Queue a read like esp32_i2c_write_read(), without waiting for it.
+ * The caller can do other work or block until the callback signals it;
+ * data must stay valid until then.
+ *
+ * @param device_address I2C slave device address.
+ * @param register_address Address of the first register to read from.
+ * @param size Number of registers to read, at least 1.
+ * @param data Buffer to store the read data in.
+ * @param done Callback to run on completion, can be NULL.
+ * @param arg Argument for the callback.
+ *
+ * @return ESP_OK when queued (the callback will run), ESP_ERR_INVALID_STATE if
+ * the task is not started or ESP_ERR_NO_MEM if the queue is full.
+ */
+esp_err_t esp32_i2c_write_read_async
+(
+    uint8_t device_address,
+    uint8_t register_address,
+    size_t size,
+    uint8_t* data,
+    esp32_i2c_done_cb_t done,
+    void* arg
+);
+
 /**
  * @brief Read multiple bytes from 8-bit registers.
  *
@@ -32,7 +101,7 @@ void select_register(uint8_t device_address, uint8_t register_address);
  * @param size Number of registers to read.
  * @param data Buffer to store the read data in.
  * 
- * @return Status of read operation.
+ * @return Status of read operation, 0 when it failed.
  */
 int8_t esp32_i2c_read_bytes
 (
@@ -104,7 +173,7 @@ int8_t esp32_i2c_read_bit
  * @param size Number of bytes to write.
  * @param data Array of bytes to write.
  * 
- * @return Status of write operation.
+ * @return Whether the device took the write.
  */
 bool esp32_i2c_write_bytes
 (
@@ -121,7 +190,7 @@ bool esp32_i2c_write_bytes
  * @param register_address Address of the register to write to.
  * @param dat: Array of bytes to write.
  * 
- * @return Status of write operation.
+ * @return Whether the device took the write.
  */
 bool esp32_i2c_write_byte
 (
@@ -37,6 +37,28 @@ typedef struct _mpu6050_rotation_t
     int16_t gyro_z;
 } mpu6050_rotation_t;
 
+/**
+ * @brief Configuration written at once by mpu6050_apply_config().
+ */
+typedef struct _mpu6050_config_t
+{
+    uint8_t rate;           // sample rate divider, see mpu6050_set_rate()
+    uint8_t dlpf_mode;      // see mpu6050_set_dlpf_mode()
+    uint8_t gyro_range;     // see mpu6050_set_full_scale_gyro_range()
+    uint8_t accel_range;    // see mpu6050_set_full_scale_accel_range()
+    uint8_t fifo_sources;   // FIFO_EN register, MPU6050_*_FIFO_EN_BIT bits
+    bool interrupt_mode;    // see mpu6050_set_interrupt_mode()
+    bool interrupt_drive;   // see mpu6050_set_interrupt_drive()
+    bool interrupt_latch;   // see mpu6050_set_interrupt_latch()
+    uint8_t interrupts;     // INT_ENABLE register, MPU6050_INTERRUPT_*_BIT bits
+    bool fifo_enabled;      // see mpu6050_set_fifo_enabled()
+    uint8_t clock_source;   // see mpu6050_set_clock_source()
+    bool wake_cycle;        // see mpu6050_set_wake_cycle_enabled()
+    bool temp_sensor;       // see mpu6050_set_temp_sensor_enabled()
+    uint8_t wake_frequency; // see mpu6050_set_wake_frequency()
+    uint8_t standby;        // PWR_MGMT_2 register, MPU6050_PWR2_STBY_*_BIT bits
+} mpu6050_config_t;
+
 /**
  * @brief MPU6050 constructor.
  */
@@ -50,6 +72,31 @@ void mpu6050_init();
  */
 bool mpu6050_test_connection();
 
+/**
+ * @brief Keep configuration registers in RAM.
+ * Registers are read once in a few bursts when enabled. Afterwards setters of
+ * bitfields in them write the register without reading it first, and
+ * mpu6050_apply_config() writes only the registers that change. Shadow is
+ * dropped by mpu6050_reset(), as the device restores its defaults.
+ *
+ * @param enabled Whether to keep the shadow.
+ *
+ * @return Status of reading the registers.
+ */
+esp_err_t mpu6050_set_shadow_enabled(bool enabled);
+
+/**
+ * @brief Write the whole configuration in a few burst writes.
+ * Switching between streaming and the low power cycle mode is a single call.
+ * Enables the shadow of registers if it is not yet, see
+ * mpu6050_set_shadow_enabled(); other bits of the registers are kept.
+ *
+ * @param config Configuration to write.
+ *
+ * @return ESP_OK, or ESP_FAIL if the device did not take a write.
+ */
+esp_err_t mpu6050_apply_config(const mpu6050_config_t *config);
+
 /**
  * @brief Get MPU6050 Tag.
  * 
@@ -2149,6 +2196,15 @@ void mpu6050_set_standby_z_gyro_enabled(bool enabled);
  */
 uint16_t mpu6050_get_fifo_count();
 
+/**
+ * @brief Read current FIFO buffer size, see mpu6050_get_fifo_count().
+ *
+ * @param count Current FIFO buffer size, left unchanged on error.
+ *
+ * @return Status of the I2C transaction.
+ */
+esp_err_t mpu6050_read_fifo_count(uint16_t *count);
+
 /**
  * @brief Get byte from FIFO buffer.
  * This register is used to read and write data from the FIFO buffer. Data is
@@ -2176,7 +2232,29 @@ uint16_t mpu6050_get_fifo_count();
  * @return Byte from FIFO buffer.
  */
 uint8_t mpu6050_get_fifo_byte();
-void mpu6050_get_fifo_bytes(uint8_t *data, size_t length);
+
+/**
+ * @brief Read bytes from FIFO buffer in one burst, see mpu6050_get_fifo_byte().
+ *
+ * @param data Buffer to store the bytes in.
+ * @param length Number of bytes to read, should not exceed FIFO buffer size.
+ *
+ * @return Status of the I2C transaction. Part of the bytes may have been
+ * taken from the FIFO even when it failed.
+ */
+esp_err_t mpu6050_get_fifo_bytes(uint8_t *data, size_t length);
+
+/**
+ * @brief Queue a burst read of FIFO buffer, see esp32_i2c_write_read_async().
+ *
+ * @param data Buffer to store the bytes in, valid until done is called.
+ * @param length Number of bytes to read, at least 1.
+ * @param done Callback to run from the I2C task once the bytes are read.
+ * @param arg Argument for the callback.
+ *
+ * @return Status of queueing the read.
+ */
+esp_err_t mpu6050_get_fifo_bytes_async(uint8_t *data, size_t length, esp32_i2c_done_cb_t done, void *arg);
 
 
 /**
@@ -28,6 +28,96 @@ static uint8_t buffer[14];
 
 static float quart[4] = {1.0f, 0.0f, 0.0f, 0.0f};
 static float delta_t = 0.0f;
+
+// configuration registers as last written, see mpu6050_set_shadow_enabled()
+static uint8_t shadow[MPU6050_REGISTER_PWR_MGMT_2 + 1];
+static bool shadow_valid;
+
+// registers that change only when written; status and data are read from the device
+static bool is_shadowed(uint8_t register_address)
+{
+    return ((register_address >= MPU6050_REGISTER_SMPLRT_DIV && register_address <= MPU6050_REGISTER_I2C_SLV4_CTRL) ||
+        register_address == MPU6050_REGISTER_INT_PIN_CFG ||
+        register_address == MPU6050_REGISTER_INT_ENABLE ||
+        (register_address >= MPU6050_REGISTER_MOT_DETECT_CTRL && register_address <= MPU6050_REGISTER_PWR_MGMT_2));
+}
+
+// bits the device clears by itself once the reset they trigger is done
+static uint8_t self_clearing_bits(uint8_t register_address)
+{
+    if (register_address == MPU6050_REGISTER_USER_CTRL)
+        return ((1 << MPU6050_USERCTRL_DMP_RESET_BIT) | (1 << MPU6050_USERCTRL_FIFO_RESET_BIT) |
+            (1 << MPU6050_USERCTRL_I2C_MST_RESET_BIT) | (1 << MPU6050_USERCTRL_SIG_COND_RESET_BIT));
+    if (register_address == MPU6050_REGISTER_PWR_MGMT_1)
+        return (1 << MPU6050_PWR1_DEVICE_RESET_BIT);
+    return (0);
+}
+
+static uint8_t with_bits(uint8_t value, uint8_t bit_start, uint8_t size, uint8_t data)
+{
+    uint8_t mask = ((1 << size) - 1) << (bit_start - size + 1);
+
+    return ((value & ~mask) | ((data << (bit_start - size + 1)) & mask));
+}
+
+static bool shadow_write_byte(uint8_t device_address, uint8_t register_address, uint8_t data)
+{
+    if (!esp32_i2c_write_byte(device_address, register_address, data))
+        return (false);
+
+    if (shadow_valid && is_shadowed(register_address))
+        shadow[register_address] = data & ~self_clearing_bits(register_address);
+
+    return (true);
+}
+
+static bool shadow_write_bits
+(
+    uint8_t device_address,
+    uint8_t register_address,
+    uint8_t bit_start,
+    uint8_t size,
+    uint8_t data
+)
+{
+    if (!shadow_valid || !is_shadowed(register_address))
+        return (esp32_i2c_write_bits(device_address, register_address, bit_start, size, data));
+
+    return (shadow_write_byte(device_address, register_address, with_bits(shadow[register_address], bit_start, size, data)));
+}
+
+static bool shadow_write_bit
+(
+    uint8_t device_address,
+    uint8_t register_address,
+    uint8_t bit_number,
+    uint8_t data
+)
+{
+    return (shadow_write_bits(device_address, register_address, bit_number, 1, data != 0));
+}
+
+// writes registers first..last of the shadow that differ from values in the device
+static esp_err_t write_shadow_range(const uint8_t *values, uint8_t first, uint8_t last)
+{
+    while (first <= last && values[first] == shadow[first])
+        first++;
+    while (last >= first && values[last] == shadow[last])
+        last--;
+    if (first > last)
+        return (ESP_OK);
+
+    bool written = (first == last) ?
+        esp32_i2c_write_byte(mpu6050_device_address, first, values[first]) :
+        esp32_i2c_write_bytes(mpu6050_device_address, first, last - first + 1, (uint8_t*) values + first);
+    if (!written)
+        return (ESP_FAIL);
+
+    for (uint8_t register_address = first; register_address <= last; register_address++)
+        shadow[register_address] = values[register_address] & ~self_clearing_bits(register_address);
+
+    return (ESP_OK);
+}
 void mpu6050_init()
 {
     mpu6050_device_address = MPU6050_DEVICE;
@@ -42,6 +132,91 @@ bool mpu6050_test_connection()
     return (mpu6050_get_device_id() == 0x34);
 }
 
+esp_err_t mpu6050_set_shadow_enabled(bool enabled)
+{
+    shadow_valid = false;
+    if (!enabled)
+        return (ESP_OK);
+
+    // the same ranges as in is_shadowed(), skipping the status register between them
+    esp_err_t ret = esp32_i2c_write_read
+    (
+        mpu6050_device_address,
+        MPU6050_REGISTER_SMPLRT_DIV,
+        MPU6050_REGISTER_I2C_SLV4_CTRL - MPU6050_REGISTER_SMPLRT_DIV + 1,
+        shadow + MPU6050_REGISTER_SMPLRT_DIV
+    );
+    if (ret == ESP_OK)
+        ret = esp32_i2c_write_read
+        (
+            mpu6050_device_address,
+            MPU6050_REGISTER_INT_PIN_CFG,
+            MPU6050_REGISTER_INT_ENABLE - MPU6050_REGISTER_INT_PIN_CFG + 1,
+            shadow + MPU6050_REGISTER_INT_PIN_CFG
+        );
+    if (ret == ESP_OK)
+        ret = esp32_i2c_write_read
+        (
+            mpu6050_device_address,
+            MPU6050_REGISTER_MOT_DETECT_CTRL,
+            MPU6050_REGISTER_PWR_MGMT_2 - MPU6050_REGISTER_MOT_DETECT_CTRL + 1,
+            shadow + MPU6050_REGISTER_MOT_DETECT_CTRL
+        );
+
+    shadow_valid = (ret == ESP_OK);
+
+    return (ret);
+}
+
+esp_err_t mpu6050_apply_config(const mpu6050_config_t *config)
+{
+    if (!shadow_valid) {
+        esp_err_t ret = mpu6050_set_shadow_enabled(true);
+        if (ret != ESP_OK)
+            return (ret);
+    }
+
+    uint8_t values[sizeof(shadow)];
+    memcpy(values, shadow, sizeof(values));
+
+    values[MPU6050_REGISTER_SMPLRT_DIV] = config->rate;
+    values[MPU6050_REGISTER_CONFIG] = with_bits(values[MPU6050_REGISTER_CONFIG],
+        MPU6050_CFG_DLPF_CFG_BIT, MPU6050_CFG_DLPF_CFG_LENGTH, config->dlpf_mode);
+    values[MPU6050_REGISTER_GYRO_CONFIG] = with_bits(values[MPU6050_REGISTER_GYRO_CONFIG],
+        MPU6050_GCONFIG_FS_SEL_BIT, MPU6050_GCONFIG_FS_SEL_LENGTH, config->gyro_range);
+    values[MPU6050_REGISTER_ACCEL_CONFIG] = with_bits(values[MPU6050_REGISTER_ACCEL_CONFIG],
+        MPU6050_ACONFIG_AFS_SEL_BIT, MPU6050_ACONFIG_AFS_SEL_LENGTH, config->accel_range);
+    values[MPU6050_REGISTER_FIFO_EN] = config->fifo_sources;
+    values[MPU6050_REGISTER_INT_PIN_CFG] = with_bits(values[MPU6050_REGISTER_INT_PIN_CFG],
+        MPU6050_INTCFG_INT_LEVEL_BIT, 1, config->interrupt_mode);
+    values[MPU6050_REGISTER_INT_PIN_CFG] = with_bits(values[MPU6050_REGISTER_INT_PIN_CFG],
+        MPU6050_INTCFG_INT_OPEN_BIT, 1, config->interrupt_drive);
+    values[MPU6050_REGISTER_INT_PIN_CFG] = with_bits(values[MPU6050_REGISTER_INT_PIN_CFG],
+        MPU6050_INTCFG_LATCH_INT_EN_BIT, 1, config->interrupt_latch);
+    values[MPU6050_REGISTER_INT_ENABLE] = config->interrupts;
+    values[MPU6050_REGISTER_USER_CTRL] = with_bits(values[MPU6050_REGISTER_USER_CTRL],
+        MPU6050_USERCTRL_FIFO_EN_BIT, 1, config->fifo_enabled);
+    values[MPU6050_REGISTER_PWR_MGMT_1] = with_bits(values[MPU6050_REGISTER_PWR_MGMT_1],
+        MPU6050_PWR1_CLKSEL_BIT, MPU6050_PWR1_CLKSEL_LENGTH, config->clock_source);
+    values[MPU6050_REGISTER_PWR_MGMT_1] = with_bits(values[MPU6050_REGISTER_PWR_MGMT_1],
+        MPU6050_PWR1_CYCLE_BIT, 1, config->wake_cycle);
+    values[MPU6050_REGISTER_PWR_MGMT_1] = with_bits(values[MPU6050_REGISTER_PWR_MGMT_1],
+        MPU6050_PWR1_TEMP_DIS_BIT, 1, !config->temp_sensor);
+    values[MPU6050_REGISTER_PWR_MGMT_2] = with_bits(config->standby,
+        MPU6050_PWR2_LP_WAKE_CTRL_BIT, MPU6050_PWR2_LP_WAKE_CTRL_LENGTH, config->wake_frequency);
+
+    // sampling first, then what is fed into the FIFO and interrupts, the FIFO and power modes last
+    esp_err_t ret = write_shadow_range(values, MPU6050_REGISTER_SMPLRT_DIV, MPU6050_REGISTER_ACCEL_CONFIG);
+    if (ret == ESP_OK)
+        ret = write_shadow_range(values, MPU6050_REGISTER_FIFO_EN, MPU6050_REGISTER_FIFO_EN);
+    if (ret == ESP_OK)
+        ret = write_shadow_range(values, MPU6050_REGISTER_INT_PIN_CFG, MPU6050_REGISTER_INT_ENABLE);
+    if (ret == ESP_OK)
+        ret = write_shadow_range(values, MPU6050_REGISTER_USER_CTRL, MPU6050_REGISTER_PWR_MGMT_2);
+
+    return (ret);
+}
+
 const char* mpu6050_get_tag()
 {
     return (TAG_MPU6050);
@@ -62,7 +237,7 @@ uint8_t mpu6050_get_aux_vddio_level()
 
 void mpu6050_set_aux_vddio_level(uint8_t level)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_YG_OFFS_TC,
@@ -85,7 +260,7 @@ uint8_t mpu6050_get_rate()
 
 void mpu6050_set_rate(uint8_t rate)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_SMPLRT_DIV,
@@ -109,7 +284,7 @@ uint8_t mpu6050_get_external_frame_sync()
 
 void mpu6050_set_external_frame_sync(uint8_t sync)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_CONFIG,
@@ -135,7 +310,7 @@ uint8_t mpu6050_get_dlpf_mode()
 
 void mpu6050_set_dlpf_mode(uint8_t mode)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_CONFIG,
@@ -161,7 +336,7 @@ uint8_t mpu6050_get_full_scale_gyro_range()
 
 void mpu6050_set_full_scale_gyro_range(uint8_t range)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_GYRO_CONFIG,
@@ -271,7 +446,7 @@ bool mpu6050_get_accel_x_self_test()
 
 void mpu6050_set_accel_x_self_test(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ACCEL_CONFIG,
@@ -295,7 +470,7 @@ bool mpu6050_get_accel_y_self_test()
 
 void mpu6050_set_accel_y_self_test(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ACCEL_CONFIG,
@@ -319,7 +494,7 @@ bool mpu6050_get_accel_z_self_test()
 
 void mpu6050_set_accel_z_self_test(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ACCEL_CONFIG,
@@ -344,7 +519,7 @@ uint8_t mpu6050_get_full_scale_accel_range()
 
 void mpu6050_set_full_scale_accel_range(uint8_t range)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ACCEL_CONFIG,
@@ -367,7 +542,7 @@ uint8_t mpu6050_get_dhpf_mode()
 
 void mpu6050_set_dhpf_mode(uint8_t mode)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ACCEL_CONFIG,
@@ -391,7 +566,7 @@ uint8_t mpu6050_get_freefall_detection_threshold()
 
 void mpu6050_set_freefall_detection_threshold(uint8_t threshold)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FF_THR,
@@ -413,7 +588,7 @@ uint8_t mpu6050_get_freefall_detection_duration()
 
 void mpu6050_set_freefall_detection_duration(uint8_t duration)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FF_DUR,
@@ -435,7 +610,7 @@ uint8_t mpu6050_get_motion_detection_threshold()
 
 void mpu6050_set_motion_detection_threshold(uint8_t threshold)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_MOT_THR,
@@ -457,7 +632,7 @@ uint8_t mpu6050_get_motion_detection_duration()
 
 void mpu6050_set_motion_detection_duration(uint8_t duration)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_MOT_DUR,
@@ -479,7 +654,7 @@ uint8_t mpu6050_get_zero_motion_detection_threshold()
 
 void mpu6050_set_zero_motion_detection_threshold(uint8_t threshold)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ZRMOT_THR,
@@ -501,7 +676,7 @@ uint8_t mpu6050_get_zero_motion_detection_duration()
 
 void mpu6050_set_zero_motion_detection_duration(uint8_t duration)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ZRMOT_DUR,
@@ -524,7 +699,7 @@ bool mpu6050_get_temp_fifo_enabled()
 
 void mpu6050_set_temp_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -548,7 +723,7 @@ bool mpu6050_get_x_gyro_fifo_enabled()
 
 void mpu6050_set_x_gyro_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -572,7 +747,7 @@ bool mpu6050_get_y_gyro_fifo_enabled()
 
 void mpu6050_set_y_gyro_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -596,7 +771,7 @@ bool mpu6050_get_z_gyro_fifo_enabled()
 
 void mpu6050_set_z_gyro_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -620,7 +795,7 @@ bool mpu6050_get_accel_fifo_enabled()
 
 void mpu6050_set_accel_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -644,7 +819,7 @@ bool mpu6050_get_slave_2_fifo_enabled()
 
 void mpu6050_set_slave_2_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -668,7 +843,7 @@ bool mpu6050_get_slave_1_fifo_enabled()
 
 void mpu6050_set_slave_1_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -692,7 +867,7 @@ bool mpu6050_get_slave_0_fifo_enabled()
 
 void mpu6050_set_slave_0_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_EN,
@@ -716,7 +891,7 @@ bool mpu6050_get_multi_master_enabled()
 
 void mpu6050_set_multi_master_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_CTRL,
@@ -740,7 +915,7 @@ bool mpu6050_get_wait_for_external_sensor_enabled()
 
 void mpu6050_set_wait_for_external_sensor_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_CTRL,
@@ -764,7 +939,7 @@ bool mpu6050_get_slave_3_fifo_enabled()
 
 void mpu6050_set_slave_3_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_CTRL,
@@ -788,7 +963,7 @@ bool mpu6050_get_slave_read_write_transition_enabled()
 
 void mpu6050_set_slave_read_write_transition_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_CTRL,
@@ -813,7 +988,7 @@ uint8_t mpu6050_get_master_clock_speed()
 
 void mpu6050_set_master_clock_speed(uint8_t speed)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_CTRL,
@@ -843,7 +1018,7 @@ void mpu6050_set_slave_address(uint8_t num, uint8_t address)
     if (num > 3)
         return;
 
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_ADDR + num * 3,
@@ -871,7 +1046,7 @@ void mpu6050_set_slave_register(uint8_t num, uint8_t reg)
     if (num > 3)
         return;
 
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_REG + num * 3,
@@ -900,7 +1075,7 @@ void mpu6050_set_slave_enabled(uint8_t num, bool enabled)
     if (num > 3)
         return;
 
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_CTRL + num * 3,
@@ -930,7 +1105,7 @@ void mpu6050_set_slave_word_byte_swap(uint8_t num, bool enabled)
     if (num > 3)
         return;
 
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_CTRL + num * 3,
@@ -960,7 +1135,7 @@ void mpu6050_set_slave_write_mode(uint8_t num, bool mode)
     if (num > 3)
         return;
 
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_CTRL + num * 3,
@@ -990,7 +1165,7 @@ void mpu6050_set_slave_word_group_offset(uint8_t num, bool enabled)
     if (num > 3)
         return;
 
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_CTRL + num * 3,
@@ -1021,7 +1196,7 @@ void mpu6050_set_slave_data_length(uint8_t num, uint8_t length)
     if (num > 3)
         return;
 
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_CTRL + num * 3,
@@ -1045,7 +1220,7 @@ uint8_t mpu6050_get_slave_4_address()
 
 void mpu6050_set_slave_4_address(uint8_t address)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_ADDR,
@@ -1067,7 +1242,7 @@ uint8_t mpu6050_get_slave_4_register()
 
 void mpu6050_set_slave_4_register(uint8_t reg)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_REG,
@@ -1077,7 +1252,7 @@ void mpu6050_set_slave_4_register(uint8_t reg)
 
 void mpu6050_set_slave_4_output_byte(uint8_t data)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_DO,
@@ -1100,7 +1275,7 @@ bool mpu6050_get_slave_4_enabled()
 
 void mpu6050_set_slave_4_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_CTRL,
@@ -1124,7 +1299,7 @@ bool mpu6050_get_slave_4_interrupt_enabled()
 
 void mpu6050_set_slave_4_interrupt_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_CTRL,
@@ -1148,7 +1323,7 @@ bool mpu6050_get_slave_4_write_mode()
 
 void mpu6050_set_slave_4_write_mode(bool mode)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_CTRL,
@@ -1173,7 +1348,7 @@ uint8_t mpu6050_get_slave_4_master_delay()
 
 void mpu6050_set_slave_4_master_delay(uint8_t delay)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV4_CTRL,
@@ -1314,7 +1489,7 @@ bool mpu6050_get_interrupt_mode()
 
 void mpu6050_set_interrupt_mode(bool mode)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1338,7 +1513,7 @@ bool mpu6050_get_interrupt_drive()
 
 void mpu6050_set_interrupt_drive(bool drive)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1362,7 +1537,7 @@ bool mpu6050_get_interrupt_latch()
 
 void mpu6050_set_interrupt_latch(bool latch)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1386,7 +1561,7 @@ bool mpu6050_get_interrupt_latch_clear()
 
 void mpu6050_set_interrupt_latch_clear(bool clear)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1410,7 +1585,7 @@ bool mpu6050_get_fsync_interrupt_level()
 
 void mpu6050_set_fsync_interrupt_level(bool level)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1434,7 +1609,7 @@ bool mpu6050_get_fsync_interrupt_enabled()
 
 void mpu6050_set_fsync_interrupt_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1458,7 +1633,7 @@ bool mpu6050_get_i2c_bypass_enabled()
 
 void mpu6050_set_i2c_bypass_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1482,7 +1657,7 @@ bool mpu6050_get_clock_output_enabled()
 
 void mpu6050_set_clock_output_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_PIN_CFG,
@@ -1505,7 +1680,7 @@ uint8_t mpu6050_get_int_enabled()
 
 void mpu6050_set_int_enabled(uint8_t enabled)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -1528,7 +1703,7 @@ bool mpu6050_get_int_freefall_enabled()
 
 void mpu6050_set_int_freefall_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -1552,7 +1727,7 @@ bool mpu6050_get_int_motion_enabled()
 
 void mpu6050_set_int_motion_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -1576,7 +1751,7 @@ bool mpu6050_get_int_zero_motion_enabled()
 
 void mpu6050_set_int_zero_motion_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -1600,7 +1775,7 @@ bool mpu6050_get_int_fifo_buffer_overflow_enabled()
 
 void mpu6050_set_int_fifo_buffer_overflow_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -1624,7 +1799,7 @@ bool mpu6050_get_int_i2c_master_enabled()
 
 void mpu6050_set_int_i2c_master_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -1648,7 +1823,7 @@ bool mpu6050_get_int_data_ready_enabled()
 
 void mpu6050_set_int_data_ready_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -2040,7 +2215,7 @@ void mpu6050_set_slave_output_byte(uint8_t num, uint8_t data)
     if (num > 3)
         return;
 
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_SLV0_DO + num,
@@ -2063,7 +2238,7 @@ bool mpu6050_get_external_shadow_delay_enabled()
 
 void mpu6050_set_external_shadow_delay_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_DELAY_CTRL,
@@ -2090,7 +2265,7 @@ bool mpu6050_get_slave_delay_enabled(uint8_t num)
 
 void mpu6050_set_slave_delay_enabled(uint8_t num, bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_I2C_MST_DELAY_CTRL,
@@ -2101,7 +2276,7 @@ void mpu6050_set_slave_delay_enabled(uint8_t num, bool enabled)
 
 void mpu6050_reset_gyroscope_path()
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_SIGNAL_PATH_RESET,
@@ -2112,7 +2287,7 @@ void mpu6050_reset_gyroscope_path()
 
 void mpu6050_reset_accelerometer_path()
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_SIGNAL_PATH_RESET,
@@ -2123,7 +2298,7 @@ void mpu6050_reset_accelerometer_path()
 
 void mpu6050_reset_temperature_path()
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_SIGNAL_PATH_RESET,
@@ -2148,7 +2323,7 @@ uint8_t mpu6050_get_accelerometer_power_on_delay()
 
 void mpu6050_set_accelerometer_power_on_delay(uint8_t delay)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_MOT_DETECT_CTRL,
@@ -2174,7 +2349,7 @@ uint8_t mpu6050_get_freefall_detection_counter_decrement()
 
 void mpu6050_set_freefall_detection_counter_decrement(uint8_t decrement)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_MOT_DETECT_CTRL,
@@ -2200,7 +2375,7 @@ uint8_t mpu6050_get_motion_detection_counter_decrement()
 
 void mpu6050_set_motion_detection_counter_decrement(uint8_t decrement)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_MOT_DETECT_CTRL,
@@ -2225,7 +2400,7 @@ bool mpu6050_get_fifo_enabled()
 
 void mpu6050_set_fifo_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -2249,7 +2424,7 @@ bool mpu6050_get_i2c_master_mode_enabled()
 
 void mpu6050_set_i2c_master_mode_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -2260,7 +2435,7 @@ void mpu6050_set_i2c_master_mode_enabled(bool enabled)
 
 void mpu6050_switch_spie_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -2271,7 +2446,7 @@ void mpu6050_switch_spie_enabled(bool enabled)
 
 void mpu6050_reset_fifo()
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -2282,7 +2457,7 @@ void mpu6050_reset_fifo()
 
 void mpu6050_reset_sensors()
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -2293,7 +2468,8 @@ void mpu6050_reset_sensors()
 
 void mpu6050_reset()
 {
-    esp32_i2c_write_bit
+    shadow_valid = false;
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_1,
@@ -2317,7 +2493,7 @@ bool mpu6050_get_sleep_enabled()
 
 void mpu6050_set_sleep_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_1,
@@ -2341,7 +2517,7 @@ bool mpu6050_get_wake_cycle_enabled()
 
 void mpu6050_set_wake_cycle_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_1,
@@ -2365,7 +2541,7 @@ bool mpu6050_get_temp_sensor_enabled()
 
 void mpu6050_set_temp_sensor_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_1,
@@ -2390,7 +2566,7 @@ uint8_t mpu6050_get_clock_source()
 
 void mpu6050_set_clock_source(uint8_t source)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_1,
@@ -2416,7 +2592,7 @@ uint8_t mpu6050_get_wake_frequency()
 
 void mpu6050_set_wake_frequency(uint8_t frequency)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2441,7 +2617,7 @@ bool mpu6050_get_standby_x_accel_enabled()
 
 void mpu6050_set_standby_x_accel_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2465,7 +2641,7 @@ bool mpu6050_get_standby_y_accel_enabled()
 
 void mpu6050_set_standby_y_accel_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2489,7 +2665,7 @@ bool mpu6050_get_standby_z_accel_enabled()
 
 void mpu6050_set_standby_z_accel_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2513,7 +2689,7 @@ bool mpu6050_get_standby_x_gyro_enabled()
 
 void mpu6050_set_standby_x_gyro_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2537,7 +2713,7 @@ bool mpu6050_get_standby_y_gyro_enabled()
 
 void mpu6050_set_standby_y_gyro_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2561,7 +2737,7 @@ bool mpu6050_get_standby_z_gyro_enabled()
 
 void mpu6050_set_standby_z_gyro_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_PWR_MGMT_2,
@@ -2572,15 +2748,28 @@ void mpu6050_set_standby_z_gyro_enabled(bool enabled)
 
 uint16_t mpu6050_get_fifo_count()
 {
-    esp32_i2c_read_bytes
+    uint16_t count = 0;
+
+    mpu6050_read_fifo_count(&count);
+
+    return (count);
+}
+
+esp_err_t mpu6050_read_fifo_count(uint16_t *count)
+{
+    uint8_t count_bytes[2];
+    esp_err_t ret = esp32_i2c_write_read
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_COUNTH,
         2,
-        buffer
+        count_bytes
     );
 
-    return ((((uint16_t) buffer[0]) << 8) | buffer[1]);
+    if (ret == ESP_OK)
+        *count = (((uint16_t) count_bytes[0]) << 8) | count_bytes[1];
+
+    return (ret);
 }
 
 uint8_t mpu6050_get_fifo_byte()
@@ -2595,24 +2784,38 @@ uint8_t mpu6050_get_fifo_byte()
     return (buffer[0]);
 }
 
-void mpu6050_get_fifo_bytes(uint8_t *data, size_t length)
+esp_err_t mpu6050_get_fifo_bytes(uint8_t *data, size_t length)
 {
-    if (length > 0) {
-        esp32_i2c_read_bytes
-        (
-            mpu6050_device_address,
-            MPU6050_REGISTER_FIFO_R_W,
-            length,
-            data
-        );
-    }
-    else
+    if (length == 0) {
         *data = 0;
+        return (ESP_OK);
+    }
+
+    return (esp32_i2c_write_read
+    (
+        mpu6050_device_address,
+        MPU6050_REGISTER_FIFO_R_W,
+        length,
+        data
+    ));
+}
+
+esp_err_t mpu6050_get_fifo_bytes_async(uint8_t *data, size_t length, esp32_i2c_done_cb_t done, void *arg)
+{
+    return (esp32_i2c_write_read_async
+    (
+        mpu6050_device_address,
+        MPU6050_REGISTER_FIFO_R_W,
+        length,
+        data,
+        done,
+        arg
+    ));
 }
 
 void mpu6050_set_fifo_byte(uint8_t data)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_FIFO_R_W,
@@ -2636,7 +2839,7 @@ uint8_t mpu6050_get_device_id()
 
 void mpu6050_set_device_id(uint8_t id)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_WHO_AM_I,
@@ -2661,7 +2864,7 @@ uint8_t mpu6050_get_otp_bank_valid()
 
 void mpu6050_set_otp_bank_valid(int8_t enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_XG_OFFS_TC,
@@ -2686,7 +2889,7 @@ int8_t mpu6050_get_x_gyro_offset_tc()
 
 void mpu6050_set_x_gyro_offset_tc(int8_t offset)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_XG_OFFS_TC,
@@ -2712,7 +2915,7 @@ int8_t mpu6050_get_y_gyro_offset_tc()
 
 void mpu6050_set_y_gyro_offset_tc(int8_t offset)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_YG_OFFS_TC,
@@ -2738,7 +2941,7 @@ int8_t mpu6050_get_z_gyro_offset_tc()
 
 void mpu6050_set_z_gyro_offset_tc(int8_t offset)
 {
-    esp32_i2c_write_bits
+    shadow_write_bits
     (
         mpu6050_device_address,
         MPU6050_REGISTER_ZG_OFFS_TC,
@@ -2762,7 +2965,7 @@ int8_t mpu6050_get_x_fine_gain()
 
 void mpu6050_set_x_fine_gain(int8_t gain)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_X_FINE_GAIN,
@@ -2784,7 +2987,7 @@ int8_t mpu6050_get_y_fine_gain()
 
 void mpu6050_set_y_fine_gain(int8_t gain)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_Y_FINE_GAIN,
@@ -2806,7 +3009,7 @@ int8_t mpu6050_get_z_fine_gain()
 
 void mpu6050_set_z_fine_gain(int8_t gain)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_Z_FINE_GAIN,
@@ -2967,7 +3170,7 @@ bool mpu6050_get_int_pll_ready_enabled()
 
 void mpu6050_set_int_pll_ready_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -2991,7 +3194,7 @@ bool mpu6050_get_int_dmp_enabled()
 
 void mpu6050_set_int_dmp_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_INT_ENABLE,
@@ -3119,7 +3322,7 @@ bool mpu6050_get_dmp_enabled()
 
 void mpu6050_set_dmp_enabled(bool enabled)
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -3130,7 +3333,7 @@ void mpu6050_set_dmp_enabled(bool enabled)
 
 void mpu6050_reset_dmp()
 {
-    esp32_i2c_write_bit
+    shadow_write_bit
     (
         mpu6050_device_address,
         MPU6050_REGISTER_USER_CTRL,
@@ -3153,7 +3356,7 @@ uint8_t mpu6050_get_dmp_config_1()
 
 void mpu6050_set_dmp_config_1(uint8_t config)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_DMP_CFG_1,
@@ -3175,7 +3378,7 @@ uint8_t mpu6050_get_dmp_config_2()
 
 void mpu6050_set_dmp_config_2(uint8_t config)
 {
-    esp32_i2c_write_byte
+    shadow_write_byte
     (
         mpu6050_device_address,
         MPU6050_REGISTER_DMP_CFG_2,
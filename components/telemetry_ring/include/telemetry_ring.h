@@ -0,0 +1,99 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ring is made of sectors of four 4096 byte flash erase units, so that less space is left at their ends
+#define TELEMETRY_RING_SECTOR_SIZE 16384
+
+/*
+ * Every sector starts with this header and is followed by records packed back to back.
+ * Header is written right after the sector is erased, and flags are programmed later,
+ * which flash allows without erase as long as bits only go from 1 to 0.
+ */
+typedef struct {
+    uint16_t magic;
+    uint8_t uploaded;       // cleared after contents of the sector were sent
+    uint8_t reserved;
+    uint32_t sequence;      // increases by one for every opened sector, gives the order of sectors after reboot
+    uint32_t write_count;   // how many times the sector was erased and written, to watch the wear
+    uint32_t crc;           // CRC32 of magic, sequence and write_count, so that torn or stale headers are ignored
+} __attribute__((packed)) telemetry_sector_header_t;
+
+#define TELEMETRY_RING_MAGIC 0x5255
+
+/*
+ * Record is this header, size bytes of data and CRC32 of the data.
+ * Records of a sector end with the first one that is erased (size is 0xffff) or not committed,
+ * so after a power cut everything from the torn record on is ignored.
+ */
+typedef struct {
+    uint16_t size;
+    uint8_t committed;      // cleared after the rest of record is completely written
+    uint8_t reserved;
+} __attribute__((packed)) telemetry_record_header_t;
+
+#define TELEMETRY_RING_RECORD_OVERHEAD (sizeof(telemetry_record_header_t) + sizeof(uint32_t))
+#define TELEMETRY_RING_MAX_RECORD_SIZE (TELEMETRY_RING_SECTOR_SIZE - sizeof(telemetry_sector_header_t) - TELEMETRY_RING_RECORD_OVERHEAD)
+
+// where the ring lives: flash partition on target, RAM in tests
+typedef struct {
+    void* ctx;
+    size_t size;    // multiple of TELEMETRY_RING_SECTOR_SIZE
+    esp_err_t (*read)(void* ctx, size_t offset, void* dst, size_t size);
+    esp_err_t (*write)(void* ctx, size_t offset, const void* src, size_t size);
+    esp_err_t (*erase)(void* ctx, size_t offset, size_t size);
+} telemetry_storage_t;
+
+typedef struct {
+    const telemetry_storage_t* storage;
+    size_t verify_interval;     // every such record is read back and checked after writing, 0 disables
+    size_t appended;
+    size_t sector_count;
+
+    size_t head;                // first sector with unsent records
+    size_t sectors_pending;     // sectors from head on with unsent records, including the open one
+    size_t records_pending;
+    bool has_open;              // whether records are still appended to the last pending sector
+    size_t open_offset;         // where the next record of the open sector goes, from start of the sector
+    uint32_t next_sequence;
+} telemetry_ring_t;
+
+/*
+ * Recovers the ring by scanning sector headers: unsent sectors of the previous run are kept
+ * and records are appended to a fresh sector after them. Nothing is erased here,
+ * sectors are erased when they are opened for writing.
+ */
+esp_err_t telemetry_ring_init(telemetry_ring_t* ring, const telemetry_storage_t* storage, size_t verify_interval);
+
+/*
+ * Writes a record of at most TELEMETRY_RING_MAX_RECORD_SIZE bytes after the previous one,
+ * or to the next sector when it does not fit.
+ * Returns ESP_ERR_NO_MEM when all sectors hold unsent records,
+ * and ESP_ERR_INVALID_CRC when the record was read back and did not match, such record is not committed.
+ */
+esp_err_t telemetry_ring_append(telemetry_ring_t* ring, const void* data, size_t size);
+
+// number of sectors from head on, that will not be written anymore and can be sent
+size_t telemetry_ring_closed_sectors(const telemetry_ring_t* ring);
+
+/*
+ * Checks CRC of every committed record in first count closed sectors, without copying,
+ * data points to the whole storage mapped to memory. Returns number of corrupted records.
+ */
+size_t telemetry_ring_count_corrupted(const telemetry_ring_t* ring, const uint8_t* data, size_t count);
+
+// CRC32 as stored in records, crc of previous part allows to continue it
+uint32_t telemetry_ring_crc32(uint32_t crc, const void* data, size_t size);
+
+// marks first count closed sectors as uploaded and moves head past them
+esp_err_t telemetry_ring_mark_sent(telemetry_ring_t* ring, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,274 @@
+#include <string.h>
+
+#include "telemetry_ring.h"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char* TAG = "tm_ring";
+
+uint32_t telemetry_ring_crc32(uint32_t crc, const void* data, size_t size) {
+    return esp_rom_crc32_le(crc, data, size);
+}
+
+static uint32_t header_crc(const telemetry_sector_header_t* header) {
+    uint32_t fields[3] = {header->magic, header->sequence, header->write_count};
+    return telemetry_ring_crc32(0, fields, sizeof(fields));
+}
+
+static bool header_valid(const telemetry_sector_header_t* header) {
+    return header->magic == TELEMETRY_RING_MAGIC && header->crc == header_crc(header);
+}
+
+static size_t sector_offset(size_t sector) {
+    return sector * TELEMETRY_RING_SECTOR_SIZE;
+}
+
+static esp_err_t read_header(const telemetry_ring_t* ring, size_t sector, telemetry_sector_header_t* header) {
+    return ring->storage->read(ring->storage->ctx, sector_offset(sector), header, sizeof(*header));
+}
+
+static size_t next_sector(const telemetry_ring_t* ring, size_t sector) {
+    return (sector + 1) % ring->sector_count;
+}
+
+static size_t prev_sector(const telemetry_ring_t* ring, size_t sector) {
+    return (sector + ring->sector_count - 1) % ring->sector_count;
+}
+
+// whether the record at offset within a sector is complete, record_size is then its size with overhead
+static bool record_valid(const telemetry_record_header_t* record, size_t offset, size_t* record_size) {
+    if (record->size == 0xffff || record->committed != 0)
+        return false;
+    *record_size = TELEMETRY_RING_RECORD_OVERHEAD + record->size;
+    return offset + *record_size <= TELEMETRY_RING_SECTOR_SIZE;
+}
+
+static esp_err_t count_records(const telemetry_ring_t* ring, size_t sector, size_t* count) {
+    const telemetry_storage_t* storage = ring->storage;
+    *count = 0;
+    size_t offset = sizeof(telemetry_sector_header_t);
+    size_t record_size;
+    while (offset + sizeof(telemetry_record_header_t) <= TELEMETRY_RING_SECTOR_SIZE) {
+        telemetry_record_header_t record;
+        esp_err_t err = storage->read(storage->ctx, sector_offset(sector) + offset, &record, sizeof(record));
+        if (err != ESP_OK)
+            return err;
+        if (!record_valid(&record, offset, &record_size))
+            break;
+        (*count)++;
+        offset += record_size;
+    }
+    return ESP_OK;
+}
+
+esp_err_t telemetry_ring_init(telemetry_ring_t* ring, const telemetry_storage_t* storage, size_t verify_interval) {
+    if (storage->size % TELEMETRY_RING_SECTOR_SIZE != 0 || storage->size < 2 * TELEMETRY_RING_SECTOR_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->storage = storage;
+    ring->verify_interval = verify_interval;
+    ring->sector_count = storage->size / TELEMETRY_RING_SECTOR_SIZE;
+
+    // the newest sector is the one with the greatest sequence number
+    telemetry_sector_header_t header;
+    bool found = false;
+    size_t newest = 0;
+    uint32_t newest_sequence = 0;
+    for (size_t sector = 0; sector < ring->sector_count; sector++) {
+        esp_err_t err = read_header(ring, sector, &header);
+        if (err != ESP_OK)
+            return err;
+        if (header_valid(&header) && (!found || header.sequence > newest_sequence)) {
+            found = true;
+            newest = sector;
+            newest_sequence = header.sequence;
+        }
+    }
+    if (!found) {
+        ESP_LOGI(TAG, "no sectors found, starting empty ring of %zu sectors", ring->sector_count);
+        return ESP_OK;
+    }
+    ring->next_sequence = newest_sequence + 1;
+    ring->head = next_sector(ring, newest);
+
+    // unsent sectors directly precede the newest one, their sequence numbers go without gaps
+    size_t sector = newest;
+    uint32_t sequence = newest_sequence;
+    while (ring->sectors_pending < ring->sector_count) {
+        esp_err_t err = read_header(ring, sector, &header);
+        if (err != ESP_OK)
+            return err;
+        if (!header_valid(&header) || header.sequence != sequence || header.uploaded != 0xff)
+            break;
+        size_t count;
+        err = count_records(ring, sector, &count);
+        if (err != ESP_OK)
+            return err;
+        ring->head = sector;
+        ring->sectors_pending++;
+        ring->records_pending += count;
+        sector = prev_sector(ring, sector);
+        sequence--;
+    }
+    ESP_LOGI(TAG, "recovered %zu unsent records in %zu sectors, head is at sector %zu",
+        ring->records_pending, ring->sectors_pending, ring->head);
+    return ESP_OK;
+}
+
+// erases the sector after the pending ones and writes its header
+static esp_err_t open_sector(telemetry_ring_t* ring) {
+    size_t sector = (ring->head + ring->sectors_pending) % ring->sector_count;
+    const telemetry_storage_t* storage = ring->storage;
+
+    telemetry_sector_header_t header;
+    esp_err_t err = read_header(ring, sector, &header);
+    if (err != ESP_OK)
+        return err;
+    uint32_t write_count = header_valid(&header) ? header.write_count + 1 : 1;
+
+    err = storage->erase(storage->ctx, sector_offset(sector), TELEMETRY_RING_SECTOR_SIZE);
+    if (err != ESP_OK)
+        return err;
+    header = (telemetry_sector_header_t) {
+        .magic = TELEMETRY_RING_MAGIC,
+        .uploaded = 0xff,
+        .reserved = 0xff,
+        .sequence = ring->next_sequence,
+        .write_count = write_count,
+    };
+    header.crc = header_crc(&header);
+    err = storage->write(storage->ctx, sector_offset(sector), &header, sizeof(header));
+    if (err != ESP_OK)
+        return err;
+
+    if (ring->sectors_pending == 0)
+        ring->head = sector;
+    ring->sectors_pending++;
+    ring->next_sequence++;
+    ring->has_open = true;
+    ring->open_offset = sizeof(telemetry_sector_header_t);
+    return ESP_OK;
+}
+
+// reads the record data back in small pieces and compares it with the CRC computed at write
+static esp_err_t verify_record(const telemetry_ring_t* ring, size_t offset, size_t size, uint32_t expected) {
+    const telemetry_storage_t* storage = ring->storage;
+    uint8_t chunk[64];
+    uint32_t crc = 0;
+    for (size_t done = 0; done < size;) {
+        size_t chunk_size = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+        esp_err_t err = storage->read(storage->ctx, offset + done, chunk, chunk_size);
+        if (err != ESP_OK)
+            return err;
+        crc = telemetry_ring_crc32(crc, chunk, chunk_size);
+        done += chunk_size;
+    }
+    uint32_t stored;
+    esp_err_t err = storage->read(storage->ctx, offset + size, &stored, sizeof(stored));
+    if (err != ESP_OK)
+        return err;
+    return crc == expected && stored == expected ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+static esp_err_t write_record(telemetry_ring_t* ring, size_t offset, const void* data, size_t size) {
+    const telemetry_storage_t* storage = ring->storage;
+    telemetry_record_header_t record = {
+        .size = size,
+        .committed = 0xff,
+        .reserved = 0xff,
+    };
+    uint32_t crc = telemetry_ring_crc32(0, data, size);
+    size_t data_offset = offset + sizeof(record);
+    esp_err_t err = storage->write(storage->ctx, offset, &record, sizeof(record));
+    if (err != ESP_OK)
+        return err;
+    err = storage->write(storage->ctx, data_offset, data, size);
+    if (err != ESP_OK)
+        return err;
+    err = storage->write(storage->ctx, data_offset + size, &crc, sizeof(crc));
+    if (err != ESP_OK)
+        return err;
+    if (ring->verify_interval != 0 && ring->appended++ % ring->verify_interval == 0) {
+        err = verify_record(ring, data_offset, size, crc);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    // the record counts only after it is completely written, so a power cut leaves it uncommitted
+    uint8_t committed = 0;
+    return storage->write(storage->ctx, offset + offsetof(telemetry_record_header_t, committed), &committed, sizeof(committed));
+}
+
+esp_err_t telemetry_ring_append(telemetry_ring_t* ring, const void* data, size_t size) {
+    if (size > TELEMETRY_RING_MAX_RECORD_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+    size_t record_size = TELEMETRY_RING_RECORD_OVERHEAD + size;
+    if (ring->has_open && ring->open_offset + record_size > TELEMETRY_RING_SECTOR_SIZE)
+        ring->has_open = false;
+    if (!ring->has_open) {
+        if (ring->sectors_pending == ring->sector_count)
+            return ESP_ERR_NO_MEM;
+        esp_err_t err = open_sector(ring);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    size_t sector = (ring->head + ring->sectors_pending - 1) % ring->sector_count;
+    esp_err_t err = write_record(ring, sector_offset(sector) + ring->open_offset, data, size);
+    if (err != ESP_OK) {
+        // records after an uncommitted one are never read, and flash there cannot be written again without erase
+        ring->has_open = false;
+        return err;
+    }
+    ring->open_offset += record_size;
+    ring->records_pending++;
+    return ESP_OK;
+}
+
+size_t telemetry_ring_closed_sectors(const telemetry_ring_t* ring) {
+    return ring->sectors_pending - (ring->has_open ? 1 : 0);
+}
+
+size_t telemetry_ring_count_corrupted(const telemetry_ring_t* ring, const uint8_t* data, size_t count) {
+    size_t corrupted = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* sector = data + sector_offset((ring->head + i) % ring->sector_count);
+        size_t offset = sizeof(telemetry_sector_header_t);
+        size_t record_size;
+        while (offset + sizeof(telemetry_record_header_t) <= TELEMETRY_RING_SECTOR_SIZE) {
+            telemetry_record_header_t record;
+            memcpy(&record, sector + offset, sizeof(record));
+            if (!record_valid(&record, offset, &record_size))
+                break;
+            const uint8_t* record_data = sector + offset + sizeof(record);
+            uint32_t stored;
+            memcpy(&stored, record_data + record.size, sizeof(stored));
+            if (telemetry_ring_crc32(0, record_data, record.size) != stored)
+                corrupted++;
+            offset += record_size;
+        }
+    }
+    return corrupted;
+}
+
+esp_err_t telemetry_ring_mark_sent(telemetry_ring_t* ring, size_t count) {
+    if (count > telemetry_ring_closed_sectors(ring))
+        return ESP_ERR_INVALID_ARG;
+    const telemetry_storage_t* storage = ring->storage;
+    for (size_t i = 0; i < count; i++) {
+        size_t records;
+        esp_err_t err = count_records(ring, ring->head, &records);
+        if (err != ESP_OK)
+            return err;
+        uint8_t uploaded = 0;
+        err = storage->write(storage->ctx, sector_offset(ring->head) + offsetof(telemetry_sector_header_t, uploaded), &uploaded, 1);
+        if (err != ESP_OK)
+            return err;
+        ring->records_pending -= records;
+        ring->head = next_sector(ring, ring->head);
+        ring->sectors_pending--;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,262 @@
+#include <string.h>
+#include "unity.h"
+
+#include "telemetry_ring.h"
+
+#define SECTORS 4
+#define MAX_RECORDS 256
+
+/*
+ * RAM stand-in for the partition. Writes only clear bits as on flash,
+ * and power is cut after given number of programmed bytes, leaving the last write torn.
+ */
+static uint8_t memory[SECTORS * TELEMETRY_RING_SECTOR_SIZE];
+static int bytes_until_power_cut = -1;
+// offset of a bit that does not get programmed, as in a worn out cell
+static size_t stuck_bit_offset = SIZE_MAX;
+
+static esp_err_t ram_read(void* ctx, size_t offset, void* dst, size_t size) {
+    memcpy(dst, memory + offset, size);
+    return ESP_OK;
+}
+
+static esp_err_t ram_write(void* ctx, size_t offset, const void* src, size_t size) {
+    const uint8_t* bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        if (bytes_until_power_cut == 0)
+            return ESP_FAIL;
+        if (bytes_until_power_cut > 0)
+            bytes_until_power_cut--;
+        memory[offset + i] &= bytes[i];
+        if (offset + i == stuck_bit_offset)
+            memory[offset + i] |= 1;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ram_erase(void* ctx, size_t offset, size_t size) {
+    if (bytes_until_power_cut == 0) {
+        // erase interrupted half way
+        memset(memory + offset, 0xff, size / 2);
+        return ESP_FAIL;
+    }
+    memset(memory + offset, 0xff, size);
+    return ESP_OK;
+}
+
+static const telemetry_storage_t storage = {
+    .ctx = NULL,
+    .size = sizeof(memory),
+    .read = ram_read,
+    .write = ram_write,
+    .erase = ram_erase,
+};
+
+static uint8_t buffer[TELEMETRY_RING_MAX_RECORD_SIZE];
+
+// records that were appended successfully, in order
+static uint8_t record_values[MAX_RECORDS];
+static size_t record_sizes[MAX_RECORDS];
+static size_t records_count;
+
+static void reset_memory(void) {
+    memset(memory, 0x5a, sizeof(memory));
+    bytes_until_power_cut = -1;
+    stuck_bit_offset = SIZE_MAX;
+    records_count = 0;
+}
+
+// sizes of compressed buffers vary
+static size_t size_of(uint8_t value) {
+    return 300 + value * 37 % 700;
+}
+
+static esp_err_t append(telemetry_ring_t* ring, uint8_t value) {
+    memset(buffer, value, size_of(value));
+    esp_err_t err = telemetry_ring_append(ring, buffer, size_of(value));
+    if (err == ESP_OK) {
+        record_values[records_count] = value;
+        record_sizes[records_count] = size_of(value);
+        records_count++;
+    }
+    return err;
+}
+
+// walks committed records of sectors from head on and compares them with appended ones from first on
+static void check_records(const telemetry_ring_t* ring, size_t first, size_t count) {
+    size_t index = first;
+    for (size_t i = 0; i < ring->sectors_pending; i++) {
+        const uint8_t* sector = memory + (ring->head + i) % SECTORS * TELEMETRY_RING_SECTOR_SIZE;
+        size_t offset = sizeof(telemetry_sector_header_t);
+        while (offset + sizeof(telemetry_record_header_t) <= TELEMETRY_RING_SECTOR_SIZE) {
+            const telemetry_record_header_t* record = (const telemetry_record_header_t*) (sector + offset);
+            if (record->size == 0xffff || record->committed != 0)
+                break;
+            TEST_ASSERT_TRUE(index < first + count);
+            TEST_ASSERT_EQUAL(record_sizes[index], record->size);
+            const uint8_t* data = sector + offset + sizeof(*record);
+            for (size_t j = 0; j < record->size; j++)
+                TEST_ASSERT_EQUAL(record_values[index], data[j]);
+            uint32_t crc;
+            memcpy(&crc, data + record->size, sizeof(crc));
+            TEST_ASSERT_EQUAL(telemetry_ring_crc32(0, data, record->size), crc);
+            offset += TELEMETRY_RING_RECORD_OVERHEAD + record->size;
+            index++;
+        }
+    }
+    TEST_ASSERT_EQUAL(first + count, index);
+    TEST_ASSERT_EQUAL(count, ring->records_pending);
+}
+
+TEST_CASE("telemetry_ring starts empty on garbage", "[telemetry_ring]")
+{
+    reset_memory();
+    telemetry_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 0));
+    TEST_ASSERT_EQUAL(0, ring.sectors_pending);
+    TEST_ASSERT_EQUAL(0, ring.records_pending);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, telemetry_ring_append(&ring, buffer, TELEMETRY_RING_MAX_RECORD_SIZE + 1));
+}
+
+TEST_CASE("telemetry_ring packs records and drops newest when full", "[telemetry_ring]")
+{
+    reset_memory();
+    telemetry_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 0));
+    uint8_t value = 0;
+    while (append(&ring, value) == ESP_OK)
+        value++;
+    // records of 300 to 1000 bytes fill sectors up to the last few hundred bytes
+    TEST_ASSERT_TRUE(records_count >= SECTORS * (TELEMETRY_RING_SECTOR_SIZE - 1000) / 700);
+    TEST_ASSERT_EQUAL(SECTORS, telemetry_ring_closed_sectors(&ring));
+    check_records(&ring, 0, records_count);
+
+    size_t before = ring.records_pending;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&ring, 2));
+    size_t sent = before - ring.records_pending;
+    TEST_ASSERT_EQUAL(ESP_OK, append(&ring, 0x80));
+    TEST_ASSERT_EQUAL(SECTORS - 2, telemetry_ring_closed_sectors(&ring));
+    check_records(&ring, sent, records_count - sent);
+
+    // sector 0 was reused, its header counts the second write
+    const telemetry_sector_header_t* header = (const telemetry_sector_header_t*) memory;
+    TEST_ASSERT_EQUAL(2, header->write_count);
+}
+
+TEST_CASE("telemetry_ring recovers unsent records after reboot", "[telemetry_ring]")
+{
+    reset_memory();
+    telemetry_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 0));
+    while (ring.sectors_pending < 3)
+        TEST_ASSERT_EQUAL(ESP_OK, append(&ring, records_count));
+    size_t before = ring.records_pending;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&ring, 1));
+    size_t sent = before - ring.records_pending;
+
+    // reboot, the partially filled sector is closed and new records go to a fresh one
+    telemetry_ring_t recovered;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&recovered, &storage, 0));
+    TEST_ASSERT_EQUAL(ring.head, recovered.head);
+    TEST_ASSERT_EQUAL(2, telemetry_ring_closed_sectors(&recovered));
+    check_records(&recovered, sent, records_count - sent);
+    TEST_ASSERT_EQUAL(ESP_OK, append(&recovered, 0x40));
+    TEST_ASSERT_EQUAL(3, recovered.sectors_pending);
+    check_records(&recovered, sent, records_count - sent);
+
+    // sent sectors are not recovered after another reboot, only the one that was still open
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&recovered, 2));
+    while (recovered.sectors_pending < 2)
+        TEST_ASSERT_EQUAL(ESP_OK, append(&recovered, records_count));
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&recovered, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&recovered, &storage, 0));
+    TEST_ASSERT_EQUAL(1, recovered.sectors_pending);
+    check_records(&recovered, records_count - 1, 1);
+
+    // and nothing is pending when it is sent as well
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&recovered, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&recovered, &storage, 0));
+    TEST_ASSERT_EQUAL(0, recovered.sectors_pending);
+    TEST_ASSERT_EQUAL(0, recovered.records_pending);
+}
+
+TEST_CASE("telemetry_ring survives power cuts", "[telemetry_ring]")
+{
+    // cut the power at every point of writing two sectors, one of them being reused
+    for (size_t cut = 0; cut < 2 * (TELEMETRY_RING_SECTOR_SIZE + 2 * sizeof(telemetry_sector_header_t)); cut += 31) {
+        reset_memory();
+        telemetry_ring_t ring;
+        TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 0));
+        while (append(&ring, records_count) == ESP_OK);
+        size_t before = ring.records_pending;
+        TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&ring, 2));
+        size_t sent = before - ring.records_pending;
+        size_t written = records_count;
+
+        bytes_until_power_cut = cut;
+        uint8_t value = 0x80;
+        while (append(&ring, value) == ESP_OK)
+            value++;
+        bytes_until_power_cut = -1;
+
+        telemetry_ring_t recovered;
+        TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&recovered, &storage, 0));
+        // unsent sectors are never touched, records written completely are never lost
+        TEST_ASSERT_EQUAL(2, recovered.head);
+        // the interrupted record itself may be committed already, when only the flag was left
+        size_t appended = records_count - written;
+        size_t recovered_count = recovered.records_pending - (written - sent);
+        TEST_ASSERT_TRUE(recovered_count == appended || recovered_count == appended + 1);
+        if (recovered_count > appended) {
+            record_values[records_count] = value;
+            record_sizes[records_count] = size_of(value);
+            records_count++;
+        }
+        check_records(&recovered, sent, records_count - sent);
+
+        // ring keeps working after everything is sent
+        TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_mark_sent(&recovered, telemetry_ring_closed_sectors(&recovered)));
+        TEST_ASSERT_EQUAL(ESP_OK, append(&recovered, 0x50));
+        TEST_ASSERT_EQUAL(1, recovered.sectors_pending);
+        check_records(&recovered, records_count - 1, 1);
+    }
+}
+
+TEST_CASE("telemetry_ring checks records with CRC", "[telemetry_ring]")
+{
+    TEST_ASSERT_EQUAL(0xcbf43926, telemetry_ring_crc32(0, "123456789", 9));
+    TEST_ASSERT_EQUAL(0xcbf43926, telemetry_ring_crc32(telemetry_ring_crc32(0, "1234", 4), "56789", 5));
+
+    reset_memory();
+    telemetry_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 0));
+    while (ring.sectors_pending < 2)
+        TEST_ASSERT_EQUAL(ESP_OK, append(&ring, records_count));
+    TEST_ASSERT_EQUAL(0, telemetry_ring_count_corrupted(&ring, memory, 1));
+
+    size_t second_record = ring.head * TELEMETRY_RING_SECTOR_SIZE + sizeof(telemetry_sector_header_t)
+        + TELEMETRY_RING_RECORD_OVERHEAD + record_sizes[0];
+    memory[second_record + sizeof(telemetry_record_header_t) + 50] ^= 0x10;
+    TEST_ASSERT_EQUAL(1, telemetry_ring_count_corrupted(&ring, memory, 1));
+
+    // bit that was not programmed is caught by read back of sampled records only
+    reset_memory();
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, append(&ring, 0));
+    size_t offset = ring.head * TELEMETRY_RING_SECTOR_SIZE + ring.open_offset;
+    stuck_bit_offset = offset + sizeof(telemetry_record_header_t) + 10;
+    TEST_ASSERT_EQUAL(ESP_OK, append(&ring, 0));
+    offset = ring.head * TELEMETRY_RING_SECTOR_SIZE + ring.open_offset;
+    stuck_bit_offset = offset + sizeof(telemetry_record_header_t) + 10;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, append(&ring, 0));
+    TEST_ASSERT_EQUAL(2, ring.records_pending);
+
+    // sector with the failed record is closed, the next record goes to a new one
+    stuck_bit_offset = SIZE_MAX;
+    TEST_ASSERT_EQUAL(ESP_OK, append(&ring, 1));
+    TEST_ASSERT_EQUAL(1, telemetry_ring_closed_sectors(&ring));
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_ring_init(&ring, &storage, 0));
+    TEST_ASSERT_EQUAL(3, ring.records_pending);
+    // record that was not sampled is caught before sending
+    TEST_ASSERT_EQUAL(1, telemetry_ring_count_corrupted(&ring, memory, 2));
+}
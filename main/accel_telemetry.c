@@ -1,83 +1,119 @@
 #include "esp_partition.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_err.h"
 #include "esp_log.h"
-#include "esp_system.h"
 #include "esp_spi_flash.h"
+#include "esp_heap_caps.h"
 #include "string.h"
+#include <stdatomic.h>
 
 #include "accel_telemetry.h"
 #include "accelerometer.h"
 #include "ow_events.h"
 #include "overwatcher_communicator.h"
+#include "upload_scheduler.h"
+#include "telemetry_ring.h"
+#include "accel_codec.h"
 
 
-#define TELEMETRY_USE_FLASH CONFIG_TELEMETRY_USE_FLASH
-
-#ifdef TELEMETRY_USE_FLASH
+#ifdef CONFIG_TELEMETRY_USE_FLASH
+#define TELEMETRY_USE_FLASH
 #define PARTITION_TYPE CONFIG_PARTITION_TYPE
 #define PARTITION_SUBTYPE CONFIG_PARTITION_SUBTYPE
 #define PARTITION_LABEL CONFIG_PARTITION_LABEL
+#else
+#define MEMORY_SIZE CONFIG_TELEMETRY_MEMORY_SIZE
 #endif
 
-#define RESERVED_SPACE CONFIG_TELEMETRY_RESERVED_SPACE
-#define BUFFER_ALIGNMENT CONFIG_TELEMETRY_BUFFER_ALIGNMENT
+#define RESERVED_SECTORS CONFIG_TELEMETRY_RESERVED_SECTORS
+#define VERIFY_INTERVAL CONFIG_TELEMETRY_VERIFY_INTERVAL
+#define WRITE_QUEUE_SIZE CONFIG_TELEMETRY_WRITE_QUEUE_SIZE
 
 static const char* TAG = "tm";
-static TaskHandle_t sending_handle;
+static SemaphoreHandle_t ring_mutex;
 
-volatile static size_t head;
-volatile static size_t tail;
+static telemetry_ring_t ring;
 #ifdef TELEMETRY_USE_FLASH
 static const esp_partition_t * storage_info;
-#endif
-// static int64_t * timestamps;
-static int32_t NUMBER_OF_BUFFERS;
 
-static uint8_t check_buffer[1024];
+static esp_err_t flash_read(void* ctx, size_t offset, void* dst, size_t size){
+    return esp_partition_read(storage_info, offset, dst, size);
+}
 
-static esp_err_t parcel_write(size_t dst_offset, const void *src, size_t size){
-    #ifdef TELEMETRY_USE_FLASH
-    ESP_ERROR_CHECK(esp_partition_write(storage_info, dst_offset, src, size));
-    ESP_ERROR_CHECK(esp_partition_read(storage_info, dst_offset, check_buffer, size));
-    
-    if (memcmp(src, check_buffer, size)){
-        ESP_LOGE(TAG, "read verification failed! ((((((((. at offset = %zu", dst_offset);
-    }
-    #else
-    #endif
-    return ESP_OK;
+static esp_err_t flash_write(void* ctx, size_t offset, const void* src, size_t size){
+    return esp_partition_write(storage_info, offset, src, size);
 }
 
+static esp_err_t flash_erase(void* ctx, size_t offset, size_t size){
+    return esp_partition_erase_range(storage_info, offset, size);
+}
 
-static esp_err_t parcel_mmap(size_t offset, size_t size, const void** out_ptr, uint32_t* out_handle){
-    #ifdef TELEMETRY_USE_FLASH
-    ESP_ERROR_CHECK(esp_partition_mmap(storage_info, offset, size, SPI_FLASH_MMAP_DATA, out_ptr, out_handle));
-    #else
-    #endif
+static telemetry_storage_t storage = {
+    .read = flash_read,
+    .write = flash_write,
+    .erase = flash_erase,
+};
+#else
+static uint8_t * memory_storage;
+
+static esp_err_t memory_read(void* ctx, size_t offset, void* dst, size_t size){
+    memcpy(dst, memory_storage + offset, size);
     return ESP_OK;
 }
 
-static esp_err_t parcel_munmap(uint32_t handle){
-    #ifdef TELEMETRY_USE_FLASH
-    spi_flash_munmap(handle);
-    #else
-    #endif
+static esp_err_t memory_write(void* ctx, size_t offset, const void* src, size_t size){
+    memcpy(memory_storage + offset, src, size);
+    return ESP_OK;
+}
+
+static esp_err_t memory_erase(void* ctx, size_t offset, size_t size){
+    memset(memory_storage + offset, 0xff, size);
     return ESP_OK;
 }
 
-static esp_err_t parcel_erase_range(size_t offset, size_t size){
+static telemetry_storage_t storage = {
+    .size = MEMORY_SIZE,
+    .read = memory_read,
+    .write = memory_write,
+    .erase = memory_erase,
+};
+#endif
+
+// buffers of the accelerometer wait here for writing task, which releases them after they are stored
+static QueueHandle_t write_queue;
+
+// every record in storage starts with this, and is followed by the buffer encoded by accel_codec
+typedef struct {
+    int64_t timestamp;      // esp_timer time of the last frame
+    uint32_t lost_samples;  // frames lost right before this buffer, including ones in dropped buffers
+} __attribute__((packed)) telemetry_record_t;
+
+static uint8_t record_buffer[sizeof(telemetry_record_t) + ACCEL_CODEC_MAX_SIZE(ACCEL_MAX_FRAMES)];
+// frames of buffers that did not make it to storage, they are reported with the next record
+static atomic_uint lost_samples;
+
+static size_t queue_high_water;
+static volatile uint32_t dropped_queue_full;
+static volatile uint32_t dropped_ring_full;
+
+
+static esp_err_t parcel_mmap(size_t offset, size_t size, const void** out_ptr, uint32_t* out_handle){
     #ifdef TELEMETRY_USE_FLASH
-    ESP_ERROR_CHECK(esp_partition_erase_range(storage_info, offset, size));
+    ESP_ERROR_CHECK(esp_partition_mmap(storage_info, offset, size, SPI_FLASH_MMAP_DATA, out_ptr, out_handle));
     #else
+    // ring is already addressable, it is handed to sending as is
+    *out_ptr = memory_storage + offset;
+    *out_handle = 0;
     #endif
     return ESP_OK;
 }
 
-static size_t parcel_size(){
+static esp_err_t parcel_munmap(uint32_t handle){
     #ifdef TELEMETRY_USE_FLASH
-    return storage_info->size;
+    spi_flash_munmap(handle);
     #else
     #endif
     return ESP_OK;
@@ -86,79 +122,144 @@ static size_t parcel_size(){
 
 static void on_got_buffer(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data){
     accel_buffer_dto_t* typed_event_data = event_data;
-    
-    size_t local_tail = tail;
-    size_t local_head = head;
 
-    int32_t buf_size = typed_event_data -> buffer_count * sizeof(*typed_event_data -> buffer);
-
-    ESP_ERROR_CHECK(parcel_write(local_tail, typed_event_data->buffer, buf_size));
-
-
-    local_tail += BUFFER_ALIGNMENT;
-    if (local_tail >= parcel_size()){
-        local_tail = 0;
-    }
-    if (local_tail == local_head){
-        ESP_LOGE(TAG, "got buffer and memory is full");
+    // event loop is shared with activity detection, so buffer is only queued here and written by writing task
+    if (xQueueSend(write_queue, typed_event_data, 0) != pdTRUE){
+        dropped_queue_full++;
+        ESP_LOGE(TAG, "got buffer and all %d queued buffers wait for writing, dropped %u so far", WRITE_QUEUE_SIZE, dropped_queue_full);
+        atomic_fetch_add(&lost_samples, typed_event_data -> lost_samples + typed_event_data -> buffer_count);
+        accelerometer_release_buffer(typed_event_data);
+        return;
     }
-    tail = local_tail;
-    ESP_LOGI(TAG, "saved buffer and increased tail to %zu", local_tail);
-    int32_t buffers_count = ((local_tail + parcel_size() - local_head) % parcel_size()) / BUFFER_ALIGNMENT;
-    ESP_LOGI(TAG, "current buffers count %u", buffers_count);
-    if (buffers_count == NUMBER_OF_BUFFERS - RESERVED_SPACE){
-        xTaskNotifyGive(sending_handle);
+    size_t used = uxQueueMessagesWaiting(write_queue);
+    if (used > queue_high_water){
+        queue_high_water = used;
     }
 }
 
 
-static void sending_task_function(void* args){
+static void writing_task_function(void* args){
+    bool nearly_full = false;
     while(1){
-        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
-        uint32_t parcel_handle;
-        const void * data;
-        parcel_mmap(0, parcel_size(), &data, &parcel_handle);
-        size_t local_tail = tail/4096*4096;
-        send_telemetry(data, parcel_size(), head, local_tail);
-        ESP_LOGI(TAG, "sent buffers and changes head from %zu to %zu", head, local_tail);
-        
-        //erasing flash:
-        if (local_tail > head){
-            ESP_LOGI(TAG, "at erase: head is %zu, tail is %zu", head, local_tail);
-            parcel_erase_range(head, local_tail-head);
+        accel_buffer_dto_t buffer_dto;
+        xQueueReceive(write_queue, &buffer_dto, portMAX_DELAY);
+
+        telemetry_record_t record = {
+            .timestamp = buffer_dto.timestamp,
+            .lost_samples = buffer_dto.lost_samples + atomic_exchange(&lost_samples, 0),
+        };
+        memcpy(record_buffer, &record, sizeof(record));
+        size_t record_size = sizeof(record) + accel_codec_encode_axes(buffer_dto.x, buffer_dto.y, buffer_dto.z,
+            buffer_dto.buffer_count, record_buffer + sizeof(record));
+        accelerometer_release_buffer(&buffer_dto);
+
+        xSemaphoreTake(ring_mutex, portMAX_DELAY);
+        esp_err_t err = telemetry_ring_append(&ring, record_buffer, record_size);
+        size_t buffers_count = ring.records_pending;
+        size_t sectors_count = ring.sectors_pending;
+        xSemaphoreGive(ring_mutex);
+
+        if (err != ESP_OK){
+            atomic_fetch_add(&lost_samples, record.lost_samples + buffer_dto.buffer_count);
+        }
+        if (err == ESP_ERR_NO_MEM){
+            dropped_ring_full++;
+            ESP_LOGE(TAG, "got buffer and memory is full, dropped %u so far", dropped_ring_full);
+        }
+        else if (err == ESP_ERR_INVALID_CRC){
+            ESP_LOGE(TAG, "read verification failed, buffer is dropped");
         }
         else{
-            ESP_LOGI(TAG, "at erase: head is %zu, tail is %zu", head, local_tail);
-            parcel_erase_range(head, parcel_size()-head);
-            parcel_erase_range(0, local_tail);
+            ESP_ERROR_CHECK(err);
+        }
+        ESP_LOGI(TAG, "current buffers count %zu", buffers_count);
+        // otherwise closed sectors wait for a window opened for something else; window is asked for
+        // only once the threshold is crossed, if sending fails the scheduler retries it on its own
+        bool was_nearly_full = nearly_full;
+        nearly_full = sectors_count + RESERVED_SECTORS >= ring.sector_count;
+        if (nearly_full && !was_nearly_full){
+            upload_request(0);
         }
+    }
+}
+
+
+// runs in every upload window, sends all sectors closed by then; returns whether they were delivered
+static bool send_closed_sectors(void){
+    // sectors before head are not written while they are sent, so only the range is taken under the lock
+    xSemaphoreTake(ring_mutex, portMAX_DELAY);
+    size_t head = ring.head * TELEMETRY_RING_SECTOR_SIZE;
+    size_t sectors = telemetry_ring_closed_sectors(&ring);
+    xSemaphoreGive(ring_mutex);
+    if (sectors == 0){
+        return true;
+    }
 
-        head = local_tail;
-        parcel_munmap(parcel_handle);
+    uint32_t parcel_handle;
+    const void * data;
+    parcel_mmap(0, storage.size, &data, &parcel_handle);
+    // corrupted buffers are still sent, server drops them by their CRC
+    size_t corrupted = telemetry_ring_count_corrupted(&ring, data, sectors);
+    if (corrupted > 0){
+        ESP_LOGE(TAG, "%zu buffers failed CRC check", corrupted);
     }
+    esp_err_t err = send_telemetry(data, storage.size, head, sectors * TELEMETRY_RING_SECTOR_SIZE);
+    parcel_munmap(parcel_handle);
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "sending failed, %zu sectors are kept until the next attempt", sectors);
+        return false;
+    }
+
+    xSemaphoreTake(ring_mutex, portMAX_DELAY);
+    ESP_ERROR_CHECK(telemetry_ring_mark_sent(&ring, sectors));
+    ESP_LOGI(TAG, "sent %zu sectors and changed head from %zu to %zu", sectors, head, ring.head * TELEMETRY_RING_SECTOR_SIZE);
+    xSemaphoreGive(ring_mutex);
+    return true;
 }
 
 void telemetry_init(void){
     #ifdef TELEMETRY_USE_FLASH
     esp_partition_iterator_t storage_iter = esp_partition_find(PARTITION_TYPE, PARTITION_SUBTYPE, PARTITION_LABEL);
-    // TODO: records timestamps in memory, maybe later
     if (storage_iter == NULL){
         ESP_LOGE(TAG, "did not find partition table for storing buffers");
         abort();
     }
     storage_info = esp_partition_get(storage_iter);
     esp_partition_iterator_release(storage_iter);
-    ESP_ERROR_CHECK(esp_partition_erase_range(storage_info, 0, storage_info -> size));
-    ESP_LOGI(TAG, "Initialized erased storage, size is %zu", storage_info -> size);
-    
-    NUMBER_OF_BUFFERS = storage_info -> size / BUFFER_ALIGNMENT;
-    head = (esp_random() % NUMBER_OF_BUFFERS)/4*4 * BUFFER_ALIGNMENT; //head should be aligned 4096 (for erase_range()), buffer alignment is 1024
-    tail = head;
+    storage.size = storage_info -> size;
     #else
-    
+    // prefer PSRAM when the board has it, internal RAM is needed for everything else
+    memory_storage = heap_caps_malloc(MEMORY_SIZE, MALLOC_CAP_SPIRAM);
+    if (memory_storage == NULL){
+        memory_storage = heap_caps_malloc(MEMORY_SIZE, MALLOC_CAP_8BIT);
+    }
+    if (memory_storage == NULL){
+        ESP_LOGE(TAG, "could not allocate %d bytes for storing buffers", MEMORY_SIZE);
+        abort();
+    }
+    // nothing survives reboot in RAM, so the ring starts empty instead of parsing garbage
+    memset(memory_storage, 0xff, MEMORY_SIZE);
     #endif
 
-    xTaskCreate(sending_task_function, "sending_tm_task", 8*configMINIMAL_STACK_SIZE, NULL, 5, &sending_handle);
+    // buffers left unsent before reboot stay in the ring and go out with the first parcel
+    ESP_ERROR_CHECK(telemetry_ring_init(&ring, &storage, VERIFY_INTERVAL));
+    ESP_LOGI(TAG, "Initialized storage, size is %zu, %zu buffers are not sent yet", storage.size, ring.records_pending);
+    ring_mutex = xSemaphoreCreateMutex();
+
+    write_queue = xQueueCreate(WRITE_QUEUE_SIZE, sizeof(accel_buffer_dto_t));
+
+    // writing is below uploading and accelerometer, flash is slow but buffers wait in the queue
+    xTaskCreate(writing_task_function, "writing_tm_task", 4*configMINIMAL_STACK_SIZE, NULL, 4, NULL);
+    ESP_ERROR_CHECK(upload_register_handler(&send_closed_sectors));
+    if (telemetry_ring_closed_sectors(&ring) > 0){
+        upload_request(0);
+    }
 
-    ESP_ERROR_CHECK(esp_event_handler_register_with(accel_event_loop, OW_EVENT, OW_EVENT_ON_ACCEL_BUFFER, &on_got_buffer, NULL));
-}
\ No newline at end of file
+    ESP_ERROR_CHECK(accelerometer_register_consumer(&on_got_buffer));
+}
+
+void telemetry_get_stats(telemetry_stats_t* stats){
+    stats -> queue_high_water = queue_high_water;
+    stats -> dropped_queue_full = dropped_queue_full;
+    stats -> dropped_ring_full = dropped_ring_full;
+}
@@ -1,13 +1,15 @@
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp32_i2c_rw/esp32_i2c_rw.h"
 #include "mpu6050/mpu6050.h"
 #include "mpu6050/mpu6050_registers.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "driver/i2c.h"
-#include "endian.h"
 #include "esp_timer.h"
+#include "dsps_unpack.h"
 
 #include "ow_events.h"
 #include "activity_detection.h"
@@ -22,15 +24,241 @@ static const char* TAG = "accel";
 #define MPU6050_WIP_IO CONFIG_DEV_WIP_IO
 #define MPU6050_INT_IO CONFIG_ACCEL_INT_IO
 
-static uint8_t buffer[1024]; // to store telemetry from accelerometer after interrupt
+#define BUFFER_POOL_SIZE CONFIG_ACCEL_BUFFER_POOL_SIZE
+#define DRAIN_PERIOD_MS CONFIG_ACCEL_DRAIN_PERIOD_MS
+
+// FIFO reads are queued one at a time, just above the accelerometer task to start right away
+#define I2C_QUEUE_LENGTH 2
+#define I2C_TASK_PRIORITY 8
+
+_Static_assert(DRAIN_PERIOD_MS * ACCEL_SAMPLE_RATE_HZ < ACCEL_MAX_FRAMES * 1000 * 3 / 4,
+    "FIFO has to be drained well before it fills up");
+
+// to store telemetry read from the accelerometer FIFO, until every consumer of the event releases it
+struct accel_buffer_slot{
+    atomic_int references;
+    uint8_t buffer[ACCEL_FIFO_SIZE];
+    // one element more than the frames, as esp-dsp kernels for ESP32 load one element past the end of their input
+    int16_t axis_x[ACCEL_MAX_FRAMES + 1];
+    int16_t axis_y[ACCEL_MAX_FRAMES + 1];
+    int16_t axis_z[ACCEL_MAX_FRAMES + 1];
+};
+
+static accel_buffer_slot_t buffer_pool[BUFFER_POOL_SIZE];
+static atomic_int consumers_count;
+static volatile uint32_t dropped_buffers;
 
 static TaskHandle_t accel_handle;
 
-// convert accelerations to milli-g (where g is gravity of the Earth)
-static int16_t map_to_mg(int16_t value){
-    return ((int32_t) value) * 16000/(1<<15);
+// converts accelerations to milli-g (where g is gravity of the Earth): value * 16000 / 2^15 == value * 125 >> 8
+#define MG_SCALE 125
+#define MG_SHIFT 8
+
+// only accelerometer task takes slots, so a slot with no references stays free until it is taken
+static accel_buffer_slot_t* acquire_slot(void){
+    for (int i = 0; i < BUFFER_POOL_SIZE; i++){
+        if (atomic_load(&buffer_pool[i].references) == 0){
+            atomic_store(&buffer_pool[i].references, atomic_load(&consumers_count));
+            return &buffer_pool[i];
+        }
+    }
+    return NULL;
+}
+
+// buffer being filled by drain_fifo(), frames are stored after the few bytes that keep them aligned as before
+static accel_buffer_slot_t* current_slot;
+static size_t current_frames;
+static uint32_t pending_lost_samples;
+
+static const mpu6050_config_t streaming_config = {
+    .rate = 1000 / ACCEL_SAMPLE_RATE_HZ - 1, // sample rate is 1 kHz / (1 + rate) with dlpf enabled
+    .dlpf_mode = 2, //low pass filter
+    .gyro_range = MPU6050_GYRO_FULL_SCALE_RANGE_250,
+    .accel_range = 3, //precision stuff [-16g; 16g]
+    .fifo_sources = 1 << MPU6050_ACCEL_FIFO_EN_BIT,
+    .interrupt_mode = true, // interrupt logic level mode — active-low
+    .interrupt_drive = true, // interrupt drive mode — open-drain
+    .interrupt_latch = false, // interrupt latch mode — 50us-pulse
+    .interrupts = 1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT,
+    .fifo_enabled = true,
+    .clock_source = MPU6050_CLOCK_PLL_XGYRO,
+    .temp_sensor = true
+};
+
+#ifdef CONFIG_ACCEL_WAKE_ON_MOTION
+#define MOTION_THRESHOLD CONFIG_ACCEL_MOTION_THRESHOLD
+#define WAKE_FREQUENCY CONFIG_ACCEL_WAKE_FREQUENCY
+// no motion has to last about 2 s (in 64 ms units) before the accelerometer reports it
+#define ZERO_MOTION_DURATION 32
+
+// accelerometer alone wakes up periodically to take a sample, interrupt arrives once it differs enough
+static const mpu6050_config_t low_power_config = {
+    .rate = 1000 / ACCEL_SAMPLE_RATE_HZ - 1,
+    .dlpf_mode = 2,
+    .gyro_range = MPU6050_GYRO_FULL_SCALE_RANGE_250,
+    .accel_range = 3,
+    .fifo_sources = 0,
+    .interrupt_mode = true,
+    .interrupt_drive = true,
+    .interrupt_latch = false,
+    .interrupts = 1 << MPU6050_INTERRUPT_MOT_BIT,
+    .fifo_enabled = false,
+    .clock_source = MPU6050_CLOCK_INTERNAL,
+    .wake_cycle = true,
+    .temp_sensor = false,
+    .wake_frequency = WAKE_FREQUENCY,
+    .standby = (1 << MPU6050_PWR2_STBY_XG_BIT) | (1 << MPU6050_PWR2_STBY_YG_BIT) | (1 << MPU6050_PWR2_STBY_ZG_BIT)
+};
+#endif
+
+// set by activity detection, lets the accelerometer sleep once there is no motion
+static atomic_bool machine_inactive;
+
+// completion of the FIFO read queued by drain_fifo()
+static SemaphoreHandle_t fifo_read_done;
+static esp_err_t fifo_read_result;
+
+static void on_fifo_read(esp_err_t result, void* arg){
+    fifo_read_result = result;
+    xSemaphoreGive(fifo_read_done);
+}
+
+static mpu6050_frame_t* slot_frames(accel_buffer_slot_t* slot){
+    return (mpu6050_frame_t*)(slot -> buffer + ACCEL_FIFO_SIZE % sizeof(mpu6050_frame_t));
 }
 
+static void post_buffer(accel_buffer_slot_t* slot, int64_t timestamp){
+    mpu6050_frame_t* ptr = slot_frames(slot);
+    size_t number_of_frames = ACCEL_MAX_FRAMES;
+    // single pass over the FIFO bytes, every consumer works with the per-axis arrays
+    dsps_unpack3_be16_s16((uint8_t*) ptr, slot -> axis_x, slot -> axis_y, slot -> axis_z, number_of_frames, 1, MG_SCALE, MG_SHIFT);
+
+    accel_buffer_dto_t accel_buffer_dto = {
+        .timestamp = timestamp,
+        .lost_samples = pending_lost_samples,
+        .buffer_count = number_of_frames,
+        .x = slot -> axis_x,
+        .y = slot -> axis_y,
+        .z = slot -> axis_z,
+        .slot = slot
+    };
+    if (esp_event_post_to(accel_event_loop, OW_EVENT, OW_EVENT_ON_ACCEL_BUFFER, &accel_buffer_dto, sizeof(accel_buffer_dto), 0) != ESP_OK){
+        dropped_buffers++;
+        ESP_LOGE(TAG, "event queue is full, dropped %u buffers so far", dropped_buffers);
+        atomic_store(&slot -> references, 0);
+        pending_lost_samples += number_of_frames;
+        return;
+    }
+    pending_lost_samples = 0;
+}
+
+/*
+ * Reads all complete frames from the FIFO into buffers and posts the ones that got full.
+ * Frame that is only partially in the FIFO stays there for the next drain, so nothing is lost
+ * as long as the FIFO does not overflow between drains.
+ */
+static void drain_fifo(int64_t now, int64_t previous_drain_time){
+    uint16_t fifo_count;
+    esp_err_t err = mpu6050_read_fifo_count(&fifo_count);
+    if (err != ESP_OK){
+        // nothing was taken from the FIFO, the next drain reads these frames
+        ESP_LOGE(TAG, "failed to read FIFO count: %s", esp_err_to_name(err));
+        return;
+    }
+    if (fifo_count >= ACCEL_FIFO_SIZE){
+        // oldest frames were overwritten and the rest are no longer aligned, so all since the previous drain are lost
+        uint32_t lost_samples = ((now - previous_drain_time) * ACCEL_SAMPLE_RATE_HZ + 500000) / 1000000;
+        ESP_LOGE(TAG, "FIFO overflowed, about %u frames are lost", lost_samples);
+        // frames of the unfinished buffer are contiguous only with the lost ones, so they go too
+        pending_lost_samples += lost_samples + current_frames;
+        current_frames = 0;
+        mpu6050_reset_fifo();
+        return;
+    }
+
+    size_t available = fifo_count / sizeof(mpu6050_frame_t);
+    // buffer that got full, posted while the bus transfers the next frames
+    accel_buffer_slot_t* full_slot = NULL;
+    int64_t full_timestamp = 0;
+    while (available > 0){
+        if (current_slot == NULL){
+            current_slot = acquire_slot();
+            current_frames = 0;
+        }
+        if (current_slot == NULL){
+            if (full_slot != NULL){
+                post_buffer(full_slot, full_timestamp);
+            }
+            // consumers did not keep up, frames are thrown away but the next ones are read in time
+            dropped_buffers++;
+            ESP_LOGE(TAG, "all %d buffers are still used by consumers, dropped %u so far", BUFFER_POOL_SIZE, dropped_buffers);
+            pending_lost_samples += available;
+            mpu6050_reset_fifo();
+            return;
+        }
+        size_t frames = ACCEL_MAX_FRAMES - current_frames < available ? ACCEL_MAX_FRAMES - current_frames : available;
+        err = mpu6050_get_fifo_bytes_async((uint8_t*) (slot_frames(current_slot) + current_frames), frames * sizeof(mpu6050_frame_t),
+            &on_fifo_read, NULL);
+        if (full_slot != NULL){
+            post_buffer(full_slot, full_timestamp);
+            full_slot = NULL;
+        }
+        if (err == ESP_OK){
+            xSemaphoreTake(fifo_read_done, portMAX_DELAY);
+            err = fifo_read_result;
+        }
+        if (err != ESP_OK){
+            // it is unknown how many bytes left the FIFO, so framing is lost like on overflow
+            ESP_LOGE(TAG, "failed to read FIFO: %s", esp_err_to_name(err));
+            pending_lost_samples += current_frames + available;
+            current_frames = 0;
+            mpu6050_reset_fifo();
+            return;
+        }
+        current_frames += frames;
+        available -= frames;
+        if (current_frames == ACCEL_MAX_FRAMES){
+            // frames left in the FIFO came after the last one of the buffer
+            full_slot = current_slot;
+            full_timestamp = now - (int64_t) available * 1000000 / ACCEL_SAMPLE_RATE_HZ;
+            current_slot = NULL;
+        }
+    }
+    if (full_slot != NULL){
+        post_buffer(full_slot, full_timestamp);
+    }
+}
+
+#ifdef CONFIG_ACCEL_WAKE_ON_MOTION
+// switches to the low power mode and back on motion, for the time no buffers are posted
+static void wait_for_motion(void){
+    // frames of the unfinished buffer would be followed by a gap, so they are dropped and counted as lost
+    pending_lost_samples += current_frames;
+    current_frames = 0;
+    // FIFO interrupts before the switch must not wake the task
+    ulTaskNotifyTake(pdTRUE, 0);
+    esp_err_t err = mpu6050_apply_config(&low_power_config);
+    if (err == ESP_OK){
+        ESP_LOGI(TAG, "no motion, sleeping until there is some");
+        gpio_set_level(MPU6050_WIP_IO, 0);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        gpio_set_level(MPU6050_WIP_IO, 1);
+        mpu6050_get_int_status();
+        ESP_LOGI(TAG, "motion detected, streaming again");
+    }
+    else{
+        ESP_LOGE(TAG, "failed to switch to low power mode: %s", esp_err_to_name(err));
+    }
+    err = mpu6050_apply_config(&streaming_config);
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "failed to switch to streaming: %s", esp_err_to_name(err));
+    }
+    mpu6050_reset_fifo();
+    // activity detection gets at least one buffer before the next sleep
+    atomic_store(&machine_inactive, false);
+}
+#endif
+
 // when interrupt from accelerometer arrives, let accel_task_function() handle it
 static void IRAM_ATTR mpu_isr_handler(void* arg)
 {
@@ -46,15 +274,16 @@ static void accel_task_function(void* args){
     }
     else{
         ESP_LOGE(TAG, "failed to interact with mpu6050");
-        return;
+        // task function must not return
+        vTaskDelete(NULL);
+    }
+    // configuration registers are kept in RAM, so changing them needs only writes
+    if (mpu6050_set_shadow_enabled(true) != ESP_OK){
+        ESP_LOGE(TAG, "failed to read configuration of mpu6050");
+        vTaskDelete(NULL);
     }
-    mpu6050_set_rate(9); //100 Hz
-
     mpu6050_reset_fifo();
 
-    mpu6050_set_full_scale_accel_range(3); //precision stuff [-16g; 16g]
-    mpu6050_set_dlpf_mode(2); //low pass filter
-    
     gpio_config_t io_conf = {};
     //interrupt of rising edge
     io_conf.intr_type = GPIO_INTR_NEGEDGE;
@@ -77,44 +306,36 @@ static void accel_task_function(void* args){
     gpio_config(&io_conf);
     gpio_set_level(MPU6050_WIP_IO, 0);
 
-    mpu6050_set_interrupt_mode(true); // interrupt logic level mode — active-low
-    mpu6050_set_interrupt_drive(true); // interrupt drive mode — open-drain
-    mpu6050_set_interrupt_latch(false); // interrupt latch mode — 50us-pulse
-
-    
     gpio_isr_handler_add(MPU6050_INT_IO, mpu_isr_handler, NULL);
 
-    mpu6050_set_fifo_enabled(true);
-    mpu6050_set_int_fifo_buffer_overflow_enabled(true);
-    mpu6050_set_accel_fifo_enabled(true);
+#ifdef CONFIG_ACCEL_WAKE_ON_MOTION
+    // high-pass filtered accelerations feed motion detectors, without affecting the samples
+    mpu6050_set_dhpf_mode(MPU6050_DHPF_5);
+    mpu6050_set_motion_detection_threshold(MOTION_THRESHOLD);
+    mpu6050_set_motion_detection_duration(1);
+    mpu6050_set_zero_motion_detection_threshold(MOTION_THRESHOLD);
+    mpu6050_set_zero_motion_detection_duration(ZERO_MOTION_DURATION);
+#endif
+    if (mpu6050_apply_config(&streaming_config) != ESP_OK){
+        ESP_LOGE(TAG, "failed to configure mpu6050");
+        vTaskDelete(NULL);
+    }
+    int64_t drain_time = esp_timer_get_time();
     while(1){
-        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+        // FIFO is drained well before it overflows, interrupt on overflow only wakes the task in case it was late
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DRAIN_PERIOD_MS));
         gpio_set_level(MPU6050_WIP_IO, 1);
         mpu6050_get_int_status();
-
-        // check if interrupt was indeed caused by full fifo of the accelerometer (not some spurious interrupt)
-        int actual_buffer_size = mpu6050_get_fifo_count();
-        if (actual_buffer_size != sizeof(buffer)) {
-            ESP_LOGE(TAG, "received interrupt and buffer size is %d, while expected budder size is %zu", actual_buffer_size, sizeof(buffer));
-            continue;
-        }
-        mpu6050_get_fifo_bytes(buffer, sizeof(buffer));
-        mpu6050_frame_t* ptr = (mpu6050_frame_t*)(buffer + sizeof(buffer) % sizeof(mpu6050_frame_t));
-        size_t number_of_frames = sizeof(buffer) / sizeof(mpu6050_frame_t);
-        for (int i = 0; i < number_of_frames; i++){
-            ptr[i].x = map_to_mg(be16toh(ptr[i].x));
-            ptr[i].y = map_to_mg(be16toh(ptr[i].y));
-            ptr[i].z = map_to_mg(be16toh(ptr[i].z));
+        int64_t previous_drain_time = drain_time;
+        drain_time = esp_timer_get_time();
+        drain_fifo(drain_time, previous_drain_time);
+#ifdef CONFIG_ACCEL_WAKE_ON_MOTION
+        if (atomic_load(&machine_inactive) && mpu6050_get_zero_motion_detected()){
+            wait_for_motion();
+            drain_time = esp_timer_get_time();
         }
-        
+#endif
         gpio_set_level(MPU6050_WIP_IO, 0);
-
-        accel_buffer_dto_t accel_buffer_dto = {
-            .timestamp = esp_timer_get_time(),
-            .buffer = ptr,
-            .buffer_count = number_of_frames
-        };
-        ESP_ERROR_CHECK(esp_event_post_to(accel_event_loop, OW_EVENT, OW_EVENT_ON_ACCEL_BUFFER, &accel_buffer_dto, sizeof(accel_buffer_dto), 0));
     }
 }
 
@@ -133,6 +354,8 @@ void accelerometer_init(){
     };
     ESP_ERROR_CHECK(i2c_param_config(I2C_NUM_0, &conf));
     ESP_ERROR_CHECK(i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, 0, 0, 0));
+    ESP_ERROR_CHECK(esp32_i2c_async_init(I2C_QUEUE_LENGTH, I2C_TASK_PRIORITY));
+    fifo_read_done = xSemaphoreCreateBinary();
     
     // event loop that receives and handles event OW_EVENT_ON_ACCEL_BUFFER (when it arrives from the accelerometer)
     esp_event_loop_args_t loop_args = {
@@ -145,4 +368,21 @@ void accelerometer_init(){
     ESP_ERROR_CHECK(esp_event_loop_create(&loop_args, &accel_event_loop));
 
     xTaskCreate(accel_task_function, "accel_task", 5*configMINIMAL_STACK_SIZE, NULL, 7, &accel_handle);
-}
\ No newline at end of file
+}
+
+esp_err_t accelerometer_register_consumer(esp_event_handler_t handler){
+    atomic_fetch_add(&consumers_count, 1);
+    return esp_event_handler_register_with(accel_event_loop, OW_EVENT, OW_EVENT_ON_ACCEL_BUFFER, handler, NULL);
+}
+
+void accelerometer_release_buffer(const accel_buffer_dto_t* buffer_dto){
+    atomic_fetch_sub(&buffer_dto -> slot -> references, 1);
+}
+
+void accelerometer_set_inactive(bool inactive){
+    atomic_store(&machine_inactive, inactive);
+}
+
+uint32_t accelerometer_dropped_buffers(void){
+    return dropped_buffers;
+}
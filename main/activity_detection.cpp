@@ -1,15 +1,19 @@
 #include "esp_log.h"
 #include "math.h"
 
-#include <queue>
 #include <algorithm>
+#include <string.h>
+#include <stdlib.h>
 
 #include "ow_events.h"
 #include "esp_err.h"
 #include "activity_detection.h"
 #include "accelerometer.h"
-#include "overwatcher_communicator.h"
+#include "upload_scheduler.h"
 #include "esp_timer.h"
+#include "esp_cpu.h"
+#include "percentile.h"
+#include "spectral.h"
 
 static const char* TAG = "ad";
 
@@ -19,6 +23,11 @@ static const int INERTIA = CONFIG_ACTD_INERTIA;
 static const int BUFFERS_THRESHOLD = CONFIG_ACTD_BUFFERS_THRESHOLD; 
 static const int ACCEL_THRESHOLD = CONFIG_ACTD_ACCEL_THRESHOLD;
 static const int UPDATE_INTERVAL = CONFIG_ACTD_UPDATE_INTERVAL;
+#if CONFIG_ACTD_SHORT_INERTIA > 0
+static const int SHORT_INERTIA = CONFIG_ACTD_SHORT_INERTIA;
+static const int SHORT_BUFFERS_THRESHOLD = CONFIG_ACTD_SHORT_BUFFERS_THRESHOLD;
+static_assert(SHORT_INERTIA <= INERTIA, "short window does not fit into the history of statuses");
+#endif
 
 
 enum class machine_state{
@@ -26,57 +35,322 @@ enum class machine_state{
 };
 
 
-static int64_t last_update_time = 0;
 static volatile machine_state state = machine_state::unknown;
-static int active_state_cnt = 0;
-static std::queue<bool> past_states;
 
-static int compute_1d_metric(accel_buffer_dto_t& buffer_dto, int16_t mpu6050_frame_t::* channel) {
+// Fixed-size ring of the most recent N boolean states packed into 32-bit words.
+// Count over the whole ring is maintained on push, counts over shorter windows are computed with popcount.
+template<int N>
+struct bit_ring {
+    static const int WORDS = (N + 31) / 32;
+    uint32_t words[WORDS] = {};
+    int head = 0; // position of the next state to be written, i.e. just after the most recent one
+    int size = 0;
+    int active = 0; // number of set states in the ring
 
+    // pushes new state, evicting the oldest one when ring is full
+    void push(bool value) {
+        uint32_t& word = words[head / 32];
+        uint32_t mask = 1u << (head % 32);
+        if (size == N && (word & mask))
+            active--;
+        if (value) {
+            word |= mask;
+            active++;
+        } else {
+            word &= ~mask;
+        }
+        head = (head + 1) % N;
+        if (size < N)
+            size++;
+    }
+
+    bool full() const {
+        return size == N;
+    }
+
+    // number of set states among the most recent `window` ones
+    int count(int window) const {
+        if (window >= N)
+            return active;
+        window = std::min(window, size);
+        int start = (head - window + N) % N;
+        if (start + window <= N)
+            return count_range(start, start + window);
+        return count_range(start, N) + count_range(0, head);
+    }
+
+private:
+    // number of set states at positions [from, to)
+    int count_range(int from, int to) const {
+        int result = 0;
+        while (from < to) {
+            int bit = from % 32;
+            int len = std::min(32 - bit, to - from);
+            uint32_t mask = (len == 32 ? ~0u : (1u << len) - 1) << bit;
+            result += __builtin_popcount(words[from / 32] & mask);
+            from += len;
+        }
+        return result;
+    }
+};
+
+// conservatism of AD as ring of most recent states
+static bit_ring<INERTIA> past_states;
+
+// 10th and 90th percentiles of each axis
+static const uint16_t METRIC_PERCENTILES[] = {100, 900};
+
+// difference between 10th and 90th percentile, combining x and y axes
+static int spread_metric(const mpu6050_frame_t& low, const mpu6050_frame_t& high) {
+    return (high.x - low.x)
+        + (high.y - low.y);
+        //+ (high.z - low.z);
+}
+
+static int compute_metric(accel_buffer_dto_t& buffer_dto, mpu6050_frame_t (&percentiles)[2]) {
+    ESP_ERROR_CHECK(compute_percentiles(&buffer_dto, METRIC_PERCENTILES, 2, percentiles));
+    return spread_metric(percentiles[0], percentiles[1]);
+}
+
+#ifdef CONFIG_ACTD_METRIC_SPECTRAL
+static const int METRIC_THRESHOLD = CONFIG_ACTD_SPECTRAL_THRESHOLD;
+
+// bands of drum tumbling during washing and of spinning, borders are configured in tenths of Hz
+static const spectral_band_t SPECTRAL_BANDS[] = {
+    {CONFIG_ACTD_TUMBLE_BAND_LOW / 10.0f, CONFIG_ACTD_TUMBLE_BAND_HIGH / 10.0f},
+    {CONFIG_ACTD_SPIN_BAND_LOW / 10.0f, CONFIG_ACTD_SPIN_BAND_HIGH / 10.0f},
+};
+static const int SPECTRAL_BANDS_COUNT = sizeof(SPECTRAL_BANDS) / sizeof(SPECTRAL_BANDS[0]);
+
+// sum of amplitudes (in milli-g) of vibrations along x and y axes within the bands
+static int compute_spectral_metric(accel_buffer_dto_t& buffer_dto) {
+    float x_amplitudes[SPECTRAL_BANDS_COUNT];
+    float y_amplitudes[SPECTRAL_BANDS_COUNT];
+
+    uint32_t start = esp_cpu_get_ccount();
+#ifdef CONFIG_ACTD_SPECTRAL_FIXED_POINT
+    ESP_ERROR_CHECK(compute_band_amplitudes_s16(&buffer_dto, SPECTRAL_BANDS, SPECTRAL_BANDS_COUNT, x_amplitudes, y_amplitudes));
+#else
+    ESP_ERROR_CHECK(compute_band_amplitudes(&buffer_dto, SPECTRAL_BANDS, SPECTRAL_BANDS_COUNT, x_amplitudes, y_amplitudes));
+#endif
+    uint32_t cycles = esp_cpu_get_ccount() - start;
+
+    float metric = 0;
+    for (int i = 0; i < SPECTRAL_BANDS_COUNT; i++)
+        metric += x_amplitudes[i] + y_amplitudes[i];
+
+    ESP_LOGI(TAG, "tumble band amplitude is %.1f, spin band amplitude is %.1f, computed in %u cycles",
+        x_amplitudes[0] + y_amplitudes[0], x_amplitudes[1] + y_amplitudes[1], cycles);
+    return (int) metric;
+}
+#else
+static const int METRIC_THRESHOLD = ACCEL_THRESHOLD;
+#endif
+
+#if CONFIG_ACTD_SKETCH_WINDOW > 0
+static const int SKETCH_THRESHOLD = CONFIG_ACTD_SKETCH_THRESHOLD;
+
+// Streaming quantile sketch over the sliding window of the most recent buffers.
+// Every axis is summarized by a histogram of fixed-width buckets around a center value (values outside are clamped to the edge buckets).
+// The window is split into blocks of buffers with a histogram each, so that the oldest block can be subtracted from the window when it expires.
+// Window thus spans between (SKETCH_BLOCKS - 1) full blocks plus one buffer and SKETCH_BLOCKS blocks, i.e. from
+// 7/8 of the configured window (rounded to whole blocks) to all of it; memory does not depend on its length.
+static const int SKETCH_BUCKETS = 64;
+static const int SKETCH_BUCKET_SHIFT = 2; // bucket width is 4 milli-g, so the histogram spans +-128 milli-g around the center
+static const int SKETCH_BLOCKS = 8;
+static const int SKETCH_BLOCK_BUFFERS = std::max((CONFIG_ACTD_SKETCH_WINDOW + SKETCH_BLOCKS / 2) / SKETCH_BLOCKS, 1);
+// sketch is recentered when the buffer drifts more than a quarter of the histogram span away from the center
+static const int SKETCH_MAX_DRIFT = (SKETCH_BUCKETS / 4) << SKETCH_BUCKET_SHIFT;
+
+static int16_t mpu6050_frame_t::* const SKETCH_AXES[] = {&mpu6050_frame_t::x, &mpu6050_frame_t::y, &mpu6050_frame_t::z};
+static const int16_t* accel_buffer_dto_t::* const SKETCH_AXIS_SAMPLES[] = {&accel_buffer_dto_t::x, &accel_buffer_dto_t::y, &accel_buffer_dto_t::z};
+static const int SKETCH_AXES_COUNT = sizeof(SKETCH_AXES) / sizeof(SKETCH_AXES[0]);
+
+struct axis_sketch {
+    int16_t center;
+    uint16_t blocks[SKETCH_BLOCKS][SKETCH_BUCKETS];
+    uint32_t window[SKETCH_BUCKETS];
+};
+
+static axis_sketch sketch[SKETCH_AXES_COUNT];
+static uint32_t sketch_count = 0; // number of values of each axis in the window
+static uint32_t sketch_block_count[SKETCH_BLOCKS];
+static int sketch_block = 0;
+static int sketch_block_buffers = 0;
+
+static void sketch_reset(const mpu6050_frame_t& center) {
+    memset(sketch, 0, sizeof(sketch));
+    memset(sketch_block_count, 0, sizeof(sketch_block_count));
+    for (int a = 0; a < SKETCH_AXES_COUNT; a++)
+        sketch[a].center = center.*SKETCH_AXES[a];
+    sketch_count = 0;
+    sketch_block = 0;
+    sketch_block_buffers = 0;
+}
+
+static int sketch_bucket(const axis_sketch& axis, int16_t value) {
+    int bucket = ((value - axis.center) >> SKETCH_BUCKET_SHIFT) + SKETCH_BUCKETS / 2;
+    return std::min(std::max(bucket, 0), SKETCH_BUCKETS - 1);
+}
+
+// adds buffer to the window, evicting the oldest block if current one is complete
+// percentiles of the buffer are used to keep histograms centered at the actual values
+static void sketch_add(accel_buffer_dto_t& buffer_dto, const mpu6050_frame_t (&percentiles)[2]) {
+    mpu6050_frame_t center;
+    bool drifted = sketch_count == 0;
+    for (int a = 0; a < SKETCH_AXES_COUNT; a++) {
+        auto channel = SKETCH_AXES[a];
+        center.*channel = (percentiles[0].*channel + percentiles[1].*channel) / 2;
+        drifted |= abs(center.*channel - sketch[a].center) > SKETCH_MAX_DRIFT;
+    }
+    if (drifted) {
+        if (sketch_count != 0)
+            ESP_LOGI(TAG, "buffer drifted away from the sketch center, resetting sketch");
+        sketch_reset(center);
+    }
+
+    if (sketch_block_buffers == SKETCH_BLOCK_BUFFERS) {
+        sketch_block = (sketch_block + 1) % SKETCH_BLOCKS;
+        sketch_block_buffers = 0;
+        for (int a = 0; a < SKETCH_AXES_COUNT; a++) {
+            for (int b = 0; b < SKETCH_BUCKETS; b++)
+                sketch[a].window[b] -= sketch[a].blocks[sketch_block][b];
+            memset(sketch[a].blocks[sketch_block], 0, sizeof(sketch[a].blocks[sketch_block]));
+        }
+        sketch_count -= sketch_block_count[sketch_block];
+        sketch_block_count[sketch_block] = 0;
+    }
+
+    for (int a = 0; a < SKETCH_AXES_COUNT; a++) {
+        const int16_t* samples = buffer_dto.*SKETCH_AXIS_SAMPLES[a];
+        axis_sketch& axis = sketch[a];
+        for (size_t i = 0; i < buffer_dto.buffer_count; i++) {
+            int bucket = sketch_bucket(axis, samples[i]);
+            axis.blocks[sketch_block][bucket]++;
+            axis.window[bucket]++;
+        }
+    }
+    sketch_count += buffer_dto.buffer_count;
+    sketch_block_count[sketch_block] += buffer_dto.buffer_count;
+    sketch_block_buffers++;
+}
+
+// computes quantiles (given in permille, sorted in ascending order) of the window
+// value of the quantile is the middle of the bucket it falls into
+static void sketch_query(const uint16_t* permille, size_t count, mpu6050_frame_t* out) {
+    for (int a = 0; a < SKETCH_AXES_COUNT; a++) {
+        auto channel = SKETCH_AXES[a];
+        const axis_sketch& axis = sketch[a];
+        uint32_t cumulative = 0;
+        int b = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t rank = std::min(sketch_count * permille[i] / 1000, sketch_count - 1);
+            while (b < SKETCH_BUCKETS - 1 && cumulative + axis.window[b] <= rank)
+                cumulative += axis.window[b++];
+            out[i].*channel = axis.center + ((b - SKETCH_BUCKETS / 2) << SKETCH_BUCKET_SHIFT) + (1 << SKETCH_BUCKET_SHIFT) / 2;
+        }
+    }
+}
+#endif
+
+#ifdef CONFIG_ACTD_BENCHMARK
+// reference implementation, which sorts a copy of each axis, to compare the percentile engine against
+static int compute_1d_metric_sorted(accel_buffer_dto_t& buffer_dto, const int16_t* accel_buffer_dto_t::* channel) {
     auto n = buffer_dto.buffer_count;
-    // combine accelerations along 3 different axes
-    uint16_t magnitudes[n];
-    for (int i = 0; i < n; i++)
-        magnitudes[i] = buffer_dto.buffer[i].*channel;
+    int16_t magnitudes[ACCEL_MAX_FRAMES];
+    std::copy(buffer_dto.*channel, buffer_dto.*channel + n, magnitudes);
     std::sort(magnitudes, magnitudes + n);
 
-    // calculate difference between 10th and 90th percentile
-    return magnitudes[int(n*0.9)] - magnitudes[int(n*0.1)];;
+    return magnitudes[int(n*0.9)] - magnitudes[int(n*0.1)];
 }
 
-static int compute_metric(accel_buffer_dto_t& buffer_dto) {
-    return compute_1d_metric(buffer_dto, &mpu6050_frame_t::x)
-        + compute_1d_metric(buffer_dto, &mpu6050_frame_t::y);
-        //+ compute_1d_metric(buffer_dto, &mpu6050_frame_t::z);
+static void benchmark_metric(accel_buffer_dto_t& buffer_dto) {
+    mpu6050_frame_t percentiles[2];
+    uint32_t start = esp_cpu_get_ccount();
+    int metric = compute_metric(buffer_dto, percentiles);
+    uint32_t percentile_cycles = esp_cpu_get_ccount() - start;
+
+    start = esp_cpu_get_ccount();
+    int reference_metric = compute_1d_metric_sorted(buffer_dto, &accel_buffer_dto_t::x)
+        + compute_1d_metric_sorted(buffer_dto, &accel_buffer_dto_t::y);
+    uint32_t sort_cycles = esp_cpu_get_ccount() - start;
+
+    ESP_LOGI(TAG, "metric cycles per buffer: percentile engine %u, sort %u", percentile_cycles, sort_cycles);
+    if (metric != reference_metric){
+        ESP_LOGE(TAG, "percentile engine metric %d differs from reference %d", metric, reference_metric);
+    }
+
+#ifdef CONFIG_ACTD_METRIC_SPECTRAL
+    float x_amplitudes[SPECTRAL_BANDS_COUNT], y_amplitudes[SPECTRAL_BANDS_COUNT];
+    float x_amplitudes_s16[SPECTRAL_BANDS_COUNT], y_amplitudes_s16[SPECTRAL_BANDS_COUNT];
+    start = esp_cpu_get_ccount();
+    ESP_ERROR_CHECK(compute_band_amplitudes(&buffer_dto, SPECTRAL_BANDS, SPECTRAL_BANDS_COUNT, x_amplitudes, y_amplitudes));
+    uint32_t f32_cycles = esp_cpu_get_ccount() - start;
+
+    start = esp_cpu_get_ccount();
+    ESP_ERROR_CHECK(compute_band_amplitudes_s16(&buffer_dto, SPECTRAL_BANDS, SPECTRAL_BANDS_COUNT, x_amplitudes_s16, y_amplitudes_s16));
+    uint32_t s16_cycles = esp_cpu_get_ccount() - start;
+
+    float max_error = 0;
+    for (int i = 0; i < SPECTRAL_BANDS_COUNT; i++){
+        max_error = std::max(max_error, fabsf(x_amplitudes_s16[i] - x_amplitudes[i]));
+        max_error = std::max(max_error, fabsf(y_amplitudes_s16[i] - y_amplitudes[i]));
+    }
+    ESP_LOGI(TAG, "spectral cycles per buffer: f32 %u, s16 %u, max amplitude difference %.2f mg", f32_cycles, s16_cycles, max_error);
+#endif
 }
+#endif
 
 static void on_got_buffer(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data){
     accel_buffer_dto_t* typed_event_data = (accel_buffer_dto_t*) event_data;
 
-    int metric = compute_metric(*typed_event_data);
+#ifdef CONFIG_ACTD_BENCHMARK
+    benchmark_metric(*typed_event_data);
+#endif
+#if !defined(CONFIG_ACTD_METRIC_SPECTRAL) || CONFIG_ACTD_SKETCH_WINDOW > 0
+    mpu6050_frame_t percentiles[2];
+#endif
+#ifdef CONFIG_ACTD_METRIC_SPECTRAL
+    int metric = compute_spectral_metric(*typed_event_data);
+#else
+    int metric = compute_metric(*typed_event_data, percentiles);
+#endif
     
-    bool instantaneous_state = metric > ACCEL_THRESHOLD;
-    if (instantaneous_state){
-        active_state_cnt++;
-    }
+    bool instantaneous_state = metric > METRIC_THRESHOLD;
+
+#if CONFIG_ACTD_SKETCH_WINDOW > 0
+#ifdef CONFIG_ACTD_METRIC_SPECTRAL
+    // sketch is centered using percentiles, which spectral metric does not compute
+    ESP_ERROR_CHECK(compute_percentiles(typed_event_data, METRIC_PERCENTILES, 2, percentiles));
+#endif
+    // spread of accelerations over the whole window, which accounts for minutes of context
+    mpu6050_frame_t window_percentiles[2];
+    sketch_add(*typed_event_data, percentiles);
+    sketch_query(METRIC_PERCENTILES, 2, window_percentiles);
+    int window_metric = spread_metric(window_percentiles[0], window_percentiles[1]);
+#endif
+    accelerometer_release_buffer(typed_event_data);
 
-    // conservatism of AD as queue of most recent states
     past_states.push(instantaneous_state);
+    int active_state_cnt = past_states.count(INERTIA);
     
-    if (past_states.size() > INERTIA){
-        if (past_states.front()){
-            active_state_cnt--;
-        }
-        past_states.pop();
-    
-        machine_state new_state = active_state_cnt > BUFFERS_THRESHOLD ? machine_state::active : machine_state::inactive;
-        // initiate sending upon status update or timeout
-        if (new_state != state || esp_timer_get_time() - last_update_time > UPDATE_INTERVAL){
+    if (past_states.full()){
+        bool active = active_state_cnt > BUFFERS_THRESHOLD;
+        // short window lets the status become active faster, while the long one keeps it active through pauses
+#if CONFIG_ACTD_SHORT_INERTIA > 0
+        active |= past_states.count(SHORT_INERTIA) > SHORT_BUFFERS_THRESHOLD;
+#endif
+#if CONFIG_ACTD_SKETCH_WINDOW > 0
+        active |= window_metric > SKETCH_THRESHOLD;
+#endif
+        machine_state new_state = active ? machine_state::active : machine_state::inactive;
+        // initiate sending upon status update, sending task repeats it on timeout
+        if (new_state != state){
             state = new_state;
             
             xTaskNotifyGive(sending_handle);
-            last_update_time = esp_timer_get_time();
         }
+        accelerometer_set_inactive(!active);
         
     }
     
@@ -84,21 +358,31 @@ static void on_got_buffer(void* arg, esp_event_base_t event_base, int32_t event_
     ESP_LOGI(TAG, "instantaneous status, is %d", instantaneous_state);
     ESP_LOGI(TAG, "active buffers count is %d", active_state_cnt);
     ESP_LOGI(TAG, "chosen metric is %d", metric);
+#if CONFIG_ACTD_SKETCH_WINDOW > 0
+    ESP_LOGI(TAG, "window metric is %d", window_metric);
+#endif
     
 }
 
 static void sending_task_function(void* args){
     while(1){
-        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
-        send_status(state == machine_state::active);
-        ESP_LOGI(TAG, "sent current calculated status, which is %d", state == machine_state::active);
+        // timeout does not rely on buffers, which stop arriving while the accelerometer sleeps until motion
+        ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(UPDATE_INTERVAL / 1000));
+        if (state == machine_state::unknown){
+            continue;
+        }
+        upload_status(state == machine_state::active);
+        ESP_LOGI(TAG, "scheduled upload of current calculated status, which is %d", state == machine_state::active);
     }
 }
 
 
 void activity_detection_init(){
+#ifdef CONFIG_ACTD_METRIC_SPECTRAL
+    ESP_ERROR_CHECK(spectral_init());
+#endif
     
-    xTaskCreate(sending_task_function, "sending_ad_task", 8*configMINIMAL_STACK_SIZE, NULL, 5, &sending_handle);
+    xTaskCreate(sending_task_function, "sending_ad_task", 3*configMINIMAL_STACK_SIZE, NULL, 5, &sending_handle);
 
-    ESP_ERROR_CHECK(esp_event_handler_register_with(accel_event_loop, OW_EVENT, OW_EVENT_ON_ACCEL_BUFFER, &on_got_buffer, NULL));
+    ESP_ERROR_CHECK(accelerometer_register_consumer(&on_got_buffer));
 }
\ No newline at end of file
@@ -1,11 +1,21 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct{
+    size_t queue_high_water;        // most buffers waiting for writing to storage at once
+    uint32_t dropped_queue_full;    // buffers dropped because writing did not keep up
+    uint32_t dropped_ring_full;     // buffers dropped because storage was full of unsent ones
+} telemetry_stats_t;
+
 void telemetry_init(void);
 
+void telemetry_get_stats(telemetry_stats_t* stats);
+
 
 #ifdef __cplusplus
 }
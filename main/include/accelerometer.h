@@ -1,4 +1,5 @@
 #pragma once
+#include <stdbool.h>
 #include "esp_event.h"
 
 #ifdef __cplusplus
@@ -7,20 +8,54 @@ extern "C" {
 
 extern esp_event_loop_handle_t accel_event_loop;
 
+#define ACCEL_SAMPLE_RATE_HZ 100
+#define ACCEL_FIFO_SIZE 1024
+
 typedef struct{
     int16_t x, y, z;
 } mpu6050_frame_t;
 
+// FIFO of the accelerometer holds 170 full frames (and one truncated), buffers are of the same size
+#define ACCEL_MAX_FRAMES (ACCEL_FIFO_SIZE / sizeof(mpu6050_frame_t))
+
+
+// slot of the pool that holds the buffer, opaque for consumers
+typedef struct accel_buffer_slot accel_buffer_slot_t;
 
 typedef struct{
-    int64_t timestamp;
-    mpu6050_frame_t* buffer;
+    int64_t timestamp;      // esp_timer time of the last frame
+    uint32_t lost_samples;  // frames lost between the previous buffer and this one, when something fell behind
+                            // or an unfinished buffer was dropped before sleeping until motion;
+                            // the sleep itself is not counted, timestamps show it
     size_t buffer_count;
+    // accelerations in milli-g, in a contiguous array per axis
+    const int16_t* x;
+    const int16_t* y;
+    const int16_t* z;
+    accel_buffer_slot_t* slot;
 } accel_buffer_dto_t;
 
 
 void accelerometer_init(void);
 
+/*
+ * Registers handler of OW_EVENT_ON_ACCEL_BUFFER. Every registered handler owns a reference to the buffer
+ * and must call accelerometer_release_buffer() once it does not use it anymore, possibly from another task.
+ * Register consumers right after accelerometer_init(), before the first buffer arrives.
+ */
+esp_err_t accelerometer_register_consumer(esp_event_handler_t handler);
+
+void accelerometer_release_buffer(const accel_buffer_dto_t* buffer_dto);
+
+/*
+ * Activity detection tells whether the machine is inactive. With CONFIG_ACCEL_WAKE_ON_MOTION the accelerometer
+ * then stops posting buffers as soon as it detects no motion, and resumes once there is motion.
+ */
+void accelerometer_set_inactive(bool inactive);
+
+// buffers lost because consumers held every slot of the pool
+uint32_t accelerometer_dropped_buffers(void);
+
 
 #ifdef __cplusplus
 }
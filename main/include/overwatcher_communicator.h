@@ -1,14 +1,41 @@
 #pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void send_status(bool status);
+/*
+ * Turns wi-fi on, if it is not yet, for requests made until the matching communicator_close_window().
+ * Requests made in one window share the connection to the server; each of them opens a window of its own too.
+ * Waits for wi-fi at most timeout_ms, see start_communication().
+ */
+esp_err_t communicator_open_window(uint32_t timeout_ms);
 
-void send_telemetry(const uint8_t* data, size_t size, size_t head, size_t tail);
+void communicator_close_window(void);
 
-void send_version_telemetry();
+/*
+ * Timestamp is real time of the status, in microseconds since epoch.
+ * Returns ESP_ERR_INVALID_RESPONSE when the server rejects the status for good (4xx other than 408 and 429),
+ * so that it is not sent again, and ESP_FAIL for failures worth a retry.
+ */
+esp_err_t send_status(bool status, int64_t timestamp);
+
+esp_err_t send_telemetry(const uint8_t* data, size_t size, size_t head, size_t length);
+
+esp_err_t send_version_telemetry();
+
+typedef struct{
+    uint32_t requests;          // requests made to the server
+    uint32_t connections;       // connections opened, each with a TCP and a TLS handshake
+    uint32_t connect_time_ms;   // total time spent opening them
+    uint32_t bytes_sent;        // bodies of requests, without headers and TLS records
+    uint32_t bytes_received;    // bodies of responses
+} communicator_stats_t;
+
+void communicator_get_stats(communicator_stats_t* stats);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,21 @@
+#pragma once
+#include "esp_err.h"
+#include "accelerometer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Computes several quantiles of all three axes of the buffer at once.
+ * Quantiles are given in permille (0..1000) and must be sorted in ascending order,
+ * i-th quantile of every axis is written to out[i] (i.e. out[i].x is i-th quantile of x).
+ * Index of the quantile in the ordered buffer is buffer_count * permille / 1000.
+ *
+ * Uses static scratch memory, so must only be called from a single task (ad_evt).
+ */
+esp_err_t compute_percentiles(const accel_buffer_dto_t* buffer_dto, const uint16_t* permille, size_t count, mpu6050_frame_t* out);
+
+#ifdef __cplusplus
+}
+#endif
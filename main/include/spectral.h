@@ -0,0 +1,42 @@
+#pragma once
+#include "esp_err.h"
+#include "accelerometer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// buffer is zero-padded up to the FFT size, which gives resolution of ACCEL_SAMPLE_RATE_HZ / SPECTRAL_FFT_SIZE (~0.4 Hz)
+#define SPECTRAL_FFT_SIZE 256
+
+// frequency band, borders are in Hz
+typedef struct {
+    float low, high;
+} spectral_band_t;
+
+/*
+ * Allocates FFT twiddle tables and precomputes the window.
+ * Must be called once before compute_band_amplitudes().
+ */
+esp_err_t spectral_init(void);
+
+/*
+ * Computes amplitudes (in milli-g) of vibrations along x and y axes within each of the bands.
+ * Axes are windowed with Hann window after removing their mean, and both are transformed by a single complex FFT.
+ *
+ * Uses static working memory, so must only be called from a single task (ad_evt).
+ */
+esp_err_t compute_band_amplitudes(const accel_buffer_dto_t* buffer_dto, const spectral_band_t* bands, size_t count, float* x_out, float* y_out);
+
+/*
+ * Same as compute_band_amplitudes(), but keeps samples in int16 all the way to the band energies,
+ * using fixed-point esp-dsp kernels and a block exponent shared by both axes.
+ * Only the final per-band amplitudes are converted to float.
+ *
+ * Uses its own static working memory, so must only be called from a single task (ad_evt).
+ */
+esp_err_t compute_band_amplitudes_s16(const accel_buffer_dto_t* buffer_dto, const spectral_band_t* bands, size_t count, float* x_out, float* y_out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// sends data of a module while wi-fi is on, runs in the task of the scheduler;
+// returns whether everything was delivered, otherwise the scheduler opens another window later
+typedef bool (*upload_handler_t)(void);
+
+void upload_scheduler_init(void);
+
+/*
+ * Registers handler that is called in every upload window, so that data of the module goes out together
+ * with everything else pending. Register right after upload_scheduler_init().
+ */
+esp_err_t upload_register_handler(upload_handler_t handler);
+
+// asks for an upload window within latency_ms, sooner if something else asks for it
+void upload_request(uint32_t latency_ms);
+
+/*
+ * Status goes out within CONFIG_UPLOAD_STATUS_LATENCY seconds. Transitions are kept in NVS with their time
+ * until delivered, and replayed in order once the server is reachable, even after reboot.
+ * Call after nvs_flash_init().
+ */
+void upload_status(bool active);
+
+
+#ifdef __cplusplus
+}
+#endif
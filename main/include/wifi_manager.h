@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 #include "esp_err.h"
 
 
@@ -6,10 +7,40 @@
 extern "C" {
 #endif
 
-esp_err_t start_communication(void);
+// timeout of waiting for the connection without a deadline
+#define WIFI_WAIT_FOREVER UINT32_MAX
+// long enough to wait for a whole connection attempt, fallback to the scan included, that starts when asked for
+#define WIFI_ATTEMPT_WAIT_MS (CONFIG_WIFI_CONNECT_TIMEOUT_MS + 1000)
+
+/*
+ * Asks for connection and waits for it at most timeout_ms. Returns ESP_ERR_WIFI_NOT_CONNECT right away when
+ * the next attempt may not end before the deadline, as the scheduler backs off after failed attempts.
+ * Call stop_communication() after success.
+ */
+esp_err_t start_communication(uint32_t timeout_ms);
 void stop_communication(void);
+
+// non-blocking request for connection, released with stop_communication() whatever wifi_wait_connected() returns
+void wifi_request_connection(void);
+esp_err_t wifi_wait_connected(uint32_t timeout_ms);
+
+/*
+ * Call after nvs_flash_init(), the AP of the last connection is kept there. Reconnection goes
+ * straight to its BSSID and channel and falls back to the scan if the AP is not there anymore.
+ */
 void wifi_init(void);
 
+typedef struct{
+    uint32_t connections;
+    uint32_t fast_connections;  // made without scan, to the cached AP
+    uint32_t fast_fallbacks;    // cached AP did not answer and was scanned for
+    uint32_t connect_time_ms;   // from start of wi-fi to IP, summed over connections
+    uint32_t last_connect_ms;
+    uint32_t last_ip_ms;        // from association to IP, in the last connection
+} wifi_stats_t;
+
+void wifi_get_stats(wifi_stats_t* out);
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
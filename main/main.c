@@ -22,6 +22,7 @@
 #include "activity_detection.h"
 #include "overwatcher_communicator.h"
 #include "accel_telemetry.h"
+#include "upload_scheduler.h"
 
 
 static const char* TAG = "main";
@@ -30,6 +31,23 @@ static const char* TAG = "main";
 static void show_profile(void* pvParameters){
 	while(1){
 		ESP_LOGI(TAG, "free heap: %d", esp_get_free_heap_size());
+#ifdef CONFIG_TELEMETRY
+		telemetry_stats_t tm_stats;
+		telemetry_get_stats(&tm_stats);
+		ESP_LOGI(TAG, "telemetry queue high water: %zu, dropped: %u (queue), %u (storage)",
+			tm_stats.queue_high_water, tm_stats.dropped_queue_full, tm_stats.dropped_ring_full);
+#endif
+		ESP_LOGI(TAG, "accelerometer buffers dropped: %u", accelerometer_dropped_buffers());
+		communicator_stats_t comm_stats;
+		communicator_get_stats(&comm_stats);
+		ESP_LOGI(TAG, "requests: %u over %u connections opened in %u ms, bytes sent: %u, received: %u",
+			comm_stats.requests, comm_stats.connections, comm_stats.connect_time_ms,
+			comm_stats.bytes_sent, comm_stats.bytes_received);
+		wifi_stats_t wifi_stats;
+		wifi_get_stats(&wifi_stats);
+		ESP_LOGI(TAG, "wi-fi connections: %u (%u without scan, %u fallbacks to scan) in %u ms, last: %u ms, %u ms of them to get IP",
+			wifi_stats.connections, wifi_stats.fast_connections, wifi_stats.fast_fallbacks,
+			wifi_stats.connect_time_ms, wifi_stats.last_connect_ms, wifi_stats.last_ip_ms);
 #ifdef CONFIG_PM_PROFILING
 		ESP_ERROR_CHECK(esp_pm_dump_locks(stdout));
 #endif
@@ -64,10 +82,8 @@ void app_main(){
 	wifi_init();
 	
 	xTaskCreate(show_profile, "show_profile", configMINIMAL_STACK_SIZE * 5, NULL, 5, NULL);
-	while (start_communication() != ESP_OK){
-		ESP_LOGI(TAG, "can't connect to wi-fi, going to sleep");
-		vTaskDelay(20000 / portTICK_PERIOD_MS);
-	}
+	// wi-fi manager retries with backoff, light sleep is allowed in between
+	ESP_ERROR_CHECK(start_communication(WIFI_WAIT_FOREVER));
 	initialize_sntp();
 	while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET) {
 		ESP_LOGI(TAG, "Waiting for system time to be set...");
@@ -76,6 +92,7 @@ void app_main(){
 	stop_communication();
 	ESP_LOGI(TAG, "have system time set, initializing other modules");
 
+	upload_scheduler_init();
 	accelerometer_init();
 	activity_detection_init();
 #ifdef CONFIG_TELEMETRY
@@ -5,12 +5,15 @@
 #include "esp_app_format.h"
 #include "esp_ota_ops.h"
 #include "esp_timer.h"
+#include "esp_idf_version.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include <sys/time.h>
 #include <string.h>
-#include <memory>
 #include <string>
 
 #include "overwatcher_communicator.h"
+#include "accelerometer.h"
 #include "credentials.h"
 #include "wifi_manager.h"
 
@@ -22,14 +25,126 @@ extern const char overwatcher_ow_dcnick3_me_pem_end[]   asm("_binary_overwatcher
 static const char* TAG = "comm";
 
 namespace {
+esp_err_t _http_event_handle(esp_http_client_event_t *evt);
+
+/*
+ * Client kept for the whole uptime, so that requests within a communication window reuse its connection
+ * and, where esp-tls supports it, connections of later windows resume its TLS session instead of a full handshake.
+ * Requests come from different tasks and take turns.
+ */
+class http_session {
+	esp_http_client_handle_t client = nullptr;
+	SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+	int windows = 0;              // communication windows open, connection is closed once the last one ends
+	int64_t connect_start = 0;
+	bool connection_open = false; // from ON_CONNECTED until the connection is closed by either side
+	communicator_stats_t stats = {};
+
+	http_session() = default;
+
+public:
+	static http_session& get() {
+		static http_session session;
+		return session;
+	}
+
+	void begin(esp_http_client_method_t method, const char* url) {
+		xSemaphoreTake(lock, portMAX_DELAY);
+		if (client == nullptr) {
+			esp_http_client_config_t config;
+			memset(&config, 0, sizeof(config));
+			config.url = url;
+			config.cert_pem = overwatcher_ow_dcnick3_me_pem_start;
+			config.method = method;
+			config.event_handler = _http_event_handle;
+			config.user_data = this;
+			config.buffer_size_tx = 1024;
+#if defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+			config.save_client_session = true;
+#endif
+			client = esp_http_client_init(&config);
+			assert(client != nullptr);
+		}
+		else {
+			// connection stays open when the host is the same
+			ESP_ERROR_CHECK(esp_http_client_set_url(client, url));
+			ESP_ERROR_CHECK(esp_http_client_set_method(client, method));
+			ESP_ERROR_CHECK(esp_http_client_set_post_field(client, NULL, 0));
+		}
+		stats.requests++;
+	}
+
+	void end(bool close) {
+		// response of a streamed request may be left partially read, so its connection is not reused
+		if (close)
+			close_connection();
+		xSemaphoreGive(lock);
+	}
+
+	void close_connection() {
+		esp_http_client_close(client);
+		connection_open = false;
+	}
+
+	esp_http_client_handle_t handle() {
+		return client;
+	}
+
+	// call right before the request, so that only a connection it opens counts as new
+	bool start_request() {
+		connect_start = esp_timer_get_time();
+		return connection_open;
+	}
+
+	void on_connected() {
+		int64_t connect_time = esp_timer_get_time() - connect_start;
+		connection_open = true;
+		stats.connections++;
+		stats.connect_time_ms += connect_time / 1000;
+		ESP_LOGI(TAG, "connected in %lld ms, including TLS handshake", connect_time / 1000);
+	}
+
+	void on_disconnected() {
+		connection_open = false;
+	}
+
+	void count_sent(size_t bytes) {
+		stats.bytes_sent += bytes;
+	}
+
+	void count_received(size_t bytes) {
+		stats.bytes_received += bytes;
+	}
+
+	void open_window() {
+		xSemaphoreTake(lock, portMAX_DELAY);
+		windows++;
+		xSemaphoreGive(lock);
+	}
+
+	// wi-fi may go down afterwards, leaving the connection dead
+	void close_window() {
+		xSemaphoreTake(lock, portMAX_DELAY);
+		if (--windows == 0 && client != nullptr)
+			close_connection();
+		xSemaphoreGive(lock);
+	}
+
+	void get_stats(communicator_stats_t* copy) {
+		*copy = stats;
+	}
+};
+
 esp_err_t _http_event_handle(esp_http_client_event_t *evt)
 {
+	http_session* session = static_cast<http_session*>(evt->user_data);
 	switch(evt->event_id) {
 		case HTTP_EVENT_ERROR:
 			ESP_LOGI(TAG, "HTTP_EVENT_ERROR");
 			break;
 		case HTTP_EVENT_ON_CONNECTED:
 			ESP_LOGI(TAG, "HTTP_EVENT_ON_CONNECTED");
+			session->on_connected();
 			break;
 		case HTTP_EVENT_HEADER_SENT:
 			ESP_LOGI(TAG, "HTTP_EVENT_HEADER_SENT");
@@ -39,6 +154,7 @@ esp_err_t _http_event_handle(esp_http_client_event_t *evt)
 			break;
 		case HTTP_EVENT_ON_DATA:
 			ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
+			session->count_received(evt->data_len);
 			if (!esp_http_client_is_chunked_response(evt->client)) {
 				ESP_LOGI(TAG, "%s%.*s", "Server responded with ", evt->data_len, (char*)evt->data);
 			}
@@ -48,45 +164,39 @@ esp_err_t _http_event_handle(esp_http_client_event_t *evt)
 			break;
 		case HTTP_EVENT_DISCONNECTED:
 			ESP_LOGI(TAG, "HTTP_EVENT_DISCONNECTED");
+			session->on_disconnected();
 			break;
 	}
 	return ESP_OK;
 }
 
-struct esp_http_client_deleter {
-	void operator()(struct esp_http_client* ptr) const	
-	{
-		ESP_ERROR_CHECK(esp_http_client_cleanup(ptr));
-	}
-};
-
-using esp_http_client_holder = std::unique_ptr<struct esp_http_client, esp_http_client_deleter>;
-
-class esp_http_client_wrap : public esp_http_client_holder
+// request made with the client of the session, which is held until the request is destroyed
+class esp_http_client_wrap
 {
 private:
-	static struct esp_http_client* make_http_client(esp_http_client_method_t method, const char* url) {
-		esp_http_client_config_t config;
-		memset(&config, 0, sizeof(config));
-		config.url = url;
-		config.cert_pem = overwatcher_ow_dcnick3_me_pem_start;
-		config.method = method;
-		config.event_handler = _http_event_handle;
-		config.buffer_size_tx = 1024;
-
-		auto res = esp_http_client_init(&config);
-		assert(res != nullptr);
-		return res;
-	}
+	http_session& session;
+	bool streamed = false;
 
 public:
 	esp_http_client_wrap(esp_http_client_method_t method, const char* url)
-		: esp_http_client_holder(make_http_client(method, url))
+		: session(http_session::get())
 	{
+		session.begin(method, url);
     ESP_ERROR_CHECK(esp_http_client_set_header(get(), "Authorization", AUTH_TOKEN));
     ESP_ERROR_CHECK(esp_http_client_set_header(get(), "Content-Type", "application/json"));
 	}
 
+	~esp_http_client_wrap() {
+		session.end(streamed);
+	}
+
+	esp_http_client_wrap(esp_http_client_wrap const&) = delete;
+	esp_http_client_wrap& operator=(esp_http_client_wrap const&) = delete;
+
+	esp_http_client_handle_t get() {
+		return session.handle();
+	}
+
 	void set_post_data(const char* data, std::size_t size) {
     ESP_ERROR_CHECK(esp_http_client_set_post_field(get(), data, size));
 	}
@@ -100,7 +210,21 @@ public:
 	}
 
 	esp_err_t perform() {
-		return esp_http_client_perform(get());
+		char* post_data = nullptr;
+		int post_size = esp_http_client_get_post_field(get(), &post_data);
+		bool reused = session.start_request();
+		esp_err_t err = esp_http_client_perform(get());
+		if (err != ESP_OK && reused) {
+			// server may have closed the idle connection, the request is repeated on a new one;
+			// failure of a new connection is not retried, it would only double the timeouts
+			ESP_LOGI(TAG, "request on reused connection failed, reconnecting");
+			session.close_connection();
+			session.start_request();
+			err = esp_http_client_perform(get());
+		}
+		if (err == ESP_OK)
+			session.count_sent(post_size);
+		return err;
 	}
 
 	int status_code() {
@@ -108,11 +232,16 @@ public:
 	}
 
 	esp_err_t open(size_t write_len) {
+		streamed = true;
+		session.start_request();
 		return esp_http_client_open(get(), write_len);
 	}
 
 	int write(const char* buffer, int len) {
-		return esp_http_client_write(get(), buffer, len);
+		int written = esp_http_client_write(get(), buffer, len);
+		if (written > 0)
+			session.count_sent(written);
+		return written;
 	}
 
 	bool write_chk(const char* buffer, int len) {
@@ -131,8 +260,9 @@ public:
 class communication_holder {
 	esp_err_t status = ESP_OK;
 public:
-	communication_holder() { status = start_communication(); }
-	~communication_holder() { if (status == ESP_OK) stop_communication(); }
+	// requests open windows of their own inside the one of the caller, then the wait is not needed
+	communication_holder() { status = communicator_open_window(WIFI_ATTEMPT_WAIT_MS); }
+	~communication_holder() { if (status == ESP_OK) communicator_close_window(); }
 	communication_holder(communication_holder const&) = delete;
 	communication_holder(communication_holder&&) = delete;
 	communication_holder& operator=(communication_holder const&) = delete;
@@ -189,6 +319,13 @@ public:
 		buffer += ',';
 	}
 
+	void append_int_value(const char* key, int64_t value) {
+		append_escaped_string(key, 0);
+		buffer += ':';
+		buffer += std::to_string(value);
+		buffer += ',';
+	}
+
 	std::string finalize() {
 		if (buffer.size() <= 1)
 			return "{}";
@@ -201,37 +338,57 @@ public:
 
 }
 
-void send_status(bool status){
+esp_err_t communicator_open_window(uint32_t timeout_ms) {
+	esp_err_t err = start_communication(timeout_ms);
+	if (err == ESP_OK)
+		http_session::get().open_window();
+	return err;
+}
+
+void communicator_close_window(void) {
+	http_session::get().close_window();
+	stop_communication();
+}
+
+esp_err_t send_status(bool status, int64_t timestamp){
 	communication_holder comm;
 	if (!comm){
 		ESP_LOGE(TAG, "could not start communication, therefore did not send status");
-		return;
+		return ESP_FAIL;
 	}
 
 	esp_http_client_wrap client(HTTP_METHOD_POST, BASEURL "sensor/v1/update");
 
 	json_dict_builder builder;
 	builder.append_string_value("state", status ? "active" : "inactive");
+	builder.append_int_value("timestamp", timestamp);
 
 	auto json_status = builder.finalize();
 	client.set_post_data(json_status);
 
 	esp_err_t err = client.perform();
 
-	if (err == ESP_OK) {
-		ESP_LOGI(TAG, "sent %s", json_status.c_str());
-		ESP_LOGI(TAG, "Status = %d", client.status_code());
-	}
-	else{
+	if (err != ESP_OK) {
 		ESP_LOGE(TAG, "client_perform() failed -> did not send status");
-	}
+		return err;
+	}
+	ESP_LOGI(TAG, "sent %s", json_status.c_str());
+	ESP_LOGI(TAG, "Status = %d", client.status_code());
+	// delivered transitions are dropped from the queue, so only the ones that will never be accepted may go too
+	int status_code = client.status_code();
+	if (status_code >= 200 && status_code < 300)
+		return ESP_OK;
+	if (status_code >= 400 && status_code < 500 && status_code != 408 && status_code != 429)
+		return ESP_ERR_INVALID_RESPONSE;
+	return ESP_FAIL;
 }
 
 
 typedef struct {
 	uint32_t magic;
 	uint32_t version;
-	uint32_t local_timestamp;
+	// both taken at once, map esp_timer timestamps of records to real time
+	uint64_t local_timestamp;
 	uint64_t real_timestamp;
 	uint32_t update_rate_nominator;
 	uint32_t update_rate_denominator;
@@ -243,86 +400,89 @@ static telemetry_parcel_header_t fill_parcel_header(void){
 
 	telemetry_parcel_header_t telemetry_parcel_header;
 	telemetry_parcel_header.magic = 0x4c54574f;
-	telemetry_parcel_header.version = 2;
+	telemetry_parcel_header.version = 8;
 	telemetry_parcel_header.local_timestamp = esp_timer_get_time();
 	telemetry_parcel_header.real_timestamp = (int64_t) tv.tv_sec*1000000L + tv.tv_usec;
-	telemetry_parcel_header.update_rate_nominator = 1690; //100Hz, but every 170th value is lost
-	telemetry_parcel_header.update_rate_denominator = 17;
+	telemetry_parcel_header.update_rate_nominator = ACCEL_SAMPLE_RATE_HZ;
+	telemetry_parcel_header.update_rate_denominator = 1;
 
 	return telemetry_parcel_header;
 }
 
-void send_telemetry(const uint8_t* data, size_t size, size_t head, size_t tail){
+// body of the parcel is a sequence of 16384 byte ring sectors, each starting with telemetry_sector_header_t
+// and followed by records of telemetry_record_header_t, data and its CRC32, up to the first uncommitted one;
+// data of records are timestamp and lost samples count of a buffer, followed by the buffer encoded by accel_codec
+esp_err_t send_telemetry(const uint8_t* data, size_t size, size_t head, size_t length){
 	
 	telemetry_parcel_header_t telemetry_parcel_header = fill_parcel_header(); //fill header with time before attempting to start communication
 
 	communication_holder comm;
 	if (!comm){
-		ESP_LOGE(TAG, "could not start communication, therefore did not send status");
-		return;
+		ESP_LOGE(TAG, "could not start communication, therefore did not send telemetry");
+		return ESP_FAIL;
 	}
 
 	ESP_LOGI(TAG, "size of parcel header is %zu", sizeof(telemetry_parcel_header));
-	ESP_LOGI(TAG, "called send_telemetry with pointer to data %p, size %zu, head %zu and tail %zu", data, size, head, tail);
+	ESP_LOGI(TAG, "called send_telemetry with pointer to data %p, size %zu, head %zu and length %zu", data, size, head, length);
 	
 
 	esp_http_client_wrap client(HTTP_METHOD_POST, BASEURL "sensor/v1/telemetry");
 
 	client.set_content_type("application/octet-stream");
 
-	size_t parcel_len = (tail - head + size) % size + sizeof(telemetry_parcel_header);
+	size_t parcel_len = length + sizeof(telemetry_parcel_header);
 	if (client.open(parcel_len) != ESP_OK){
 		ESP_LOGE(TAG, "Failed to connect to server");
-		return;
+		return ESP_FAIL;
 	}
 	
 	if (!client.write_chk((char*) &telemetry_parcel_header, sizeof(telemetry_parcel_header))){
 		ESP_LOGE(TAG, "Writing header failed");
-		return;
+		return ESP_FAIL;
 	}
 
-	// data array is thought of as a queue: moving head and tail are operation analogous to writing and reading queue
-	// there are 2 scenarios, either borders of array are included into parcel or not
-	// , which, in terms of head and tail is either tail is greater that head or not
-	// so we write either from head to tail, or from head to end and from beginning to tail
-	if (tail > head) {
-		if (!client.write_chk((char*) data + head, tail-head)) {
+	// data array is thought of as a ring: the parcel either fits before the end of array,
+	// or is written from head to end and from beginning for the rest of length
+	if (head + length <= size) {
+		if (!client.write_chk((char*) data + head, length)) {
 			ESP_LOGE(TAG, "Writing measurements failed");
-			return;
+			return ESP_FAIL;
 		}
 	} else {
 		if (!client.write_chk((char*) data + head, size-head)) {
 			ESP_LOGE(TAG, "Writing measurements failed");
-			return;
+			return ESP_FAIL;
 		}
-		if (!client.write_chk((char*) data, tail)) {
+		if (!client.write_chk((char*) data, head + length - size)) {
 			ESP_LOGE(TAG, "Writing measurements failed");
-			return;
+			return ESP_FAIL;
 		}
 	}
 	
 	int content_length = client.fetch_headers();
 	if (content_length == -1){
 		ESP_LOGE(TAG, "esp_http_client_fetch_headers() failed");
-		return;
+		return ESP_FAIL;
 	}
 
 	char output_buffer[256] = {0};
 	int data_read = client.read_response(output_buffer, 255);
-	if (data_read >= 0) {
-		ESP_LOGI(TAG, "HTTP GET Status = %d", client.status_code());
-		ESP_LOGI(TAG, "%s", output_buffer);
-	} else {
+	if (data_read < 0) {
 		ESP_LOGE(TAG, "Failed to read response");
+		return ESP_FAIL;
 	}
-
+	ESP_LOGI(TAG, "HTTP GET Status = %d", client.status_code());
+	ESP_LOGI(TAG, "%s", output_buffer);
+	// sent buffers are dropped from the ring, so they are considered delivered only on success status
+	int status_code = client.status_code();
+	return status_code >= 200 && status_code < 300 ? ESP_OK : ESP_FAIL;
 }
 
-void send_version_telemetry() {
+esp_err_t send_version_telemetry() {
 	communication_holder comm;
 	if (!comm){
 		ESP_LOGE(TAG, "could not start communication, therefore did not send version telemetry");
-		return;
+		return ESP_FAIL;
 	}
 
 	esp_http_client_wrap client(HTTP_METHOD_POST, BASEURL "sensor/v1/version_telemetry");
@@ -352,5 +512,9 @@ void send_version_telemetry() {
 	else{
 		ESP_LOGE(TAG, "client_perform() failed -> did not send version telemetry");
 	}
+	return err;
+}
 
-}
\ No newline at end of file
+void communicator_get_stats(communicator_stats_t* stats) {
+	http_session::get().get_stats(stats);
+}
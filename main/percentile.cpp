@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <string.h>
+
+#include "percentile.h"
+
+// per-axis copies of the buffer, reordered in place by selection
+static int16_t scratch_x[ACCEL_MAX_FRAMES];
+static int16_t scratch_y[ACCEL_MAX_FRAMES];
+static int16_t scratch_z[ACCEL_MAX_FRAMES];
+
+// selects quantiles of one axis in ascending order
+// after std::nth_element everything right of k is not less than values[k],
+// so the next (greater) quantile is searched only in the remaining part of the array, which keeps it linear
+static void select_quantiles(int16_t* values, size_t n, const uint16_t* permille, size_t count,
+                             mpu6050_frame_t* out, int16_t mpu6050_frame_t::* channel) {
+    size_t lo = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t k = std::min(n * permille[i] / 1000, n - 1);
+        std::nth_element(values + lo, values + k, values + n);
+        out[i].*channel = values[k];
+        lo = k;
+    }
+}
+
+esp_err_t compute_percentiles(const accel_buffer_dto_t* buffer_dto, const uint16_t* permille, size_t count, mpu6050_frame_t* out) {
+    size_t n = buffer_dto->buffer_count;
+    if (n == 0 || n > ACCEL_MAX_FRAMES)
+        return ESP_ERR_INVALID_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        if (permille[i] > 1000 || (i > 0 && permille[i] < permille[i - 1]))
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    // selection reorders values, so it works on copies of the axes
+    memcpy(scratch_x, buffer_dto->x, n * sizeof(int16_t));
+    memcpy(scratch_y, buffer_dto->y, n * sizeof(int16_t));
+    memcpy(scratch_z, buffer_dto->z, n * sizeof(int16_t));
+
+    select_quantiles(scratch_x, n, permille, count, out, &mpu6050_frame_t::x);
+    select_quantiles(scratch_y, n, permille, count, out, &mpu6050_frame_t::y);
+    select_quantiles(scratch_z, n, permille, count, out, &mpu6050_frame_t::z);
+
+    return ESP_OK;
+}
@@ -0,0 +1,217 @@
+#include <math.h>
+#include <algorithm>
+
+#include "esp_log.h"
+#include "dsps_fft2r.h"
+#include "dsps_wind_hann.h"
+#include "dsps_add.h"
+#include "dsps_mul.h"
+#include "dsps_dotprod.h"
+
+#include "spectral.h"
+
+static const char* TAG = "spectral";
+
+static_assert(SPECTRAL_FFT_SIZE >= ACCEL_MAX_FRAMES, "buffer does not fit into the FFT");
+
+// x axis is stored as real part, y axis as imaginary one, so that both are transformed at once
+__attribute__((aligned(16)))
+static float fft_data[SPECTRAL_FFT_SIZE * 2];
+__attribute__((aligned(16)))
+static float window[ACCEL_MAX_FRAMES];
+static size_t window_length = 0;
+// by Parseval's theorem, energy of a sinusoid with amplitude A within its band is N * A^2 / 4 * sum of squared window coefficients,
+// and dsps_cplx2reC_fc32() leaves both spectra scaled by 2, so A = sqrt(energy / (N * sum of squares))
+static float window_gain = 0;
+
+// fixed-point pipeline has its own working memory, so that both pipelines can be compared on the same buffer
+__attribute__((aligned(16)))
+static int16_t fft_data_sc16[SPECTRAL_FFT_SIZE * 2];
+// spectra of x and y, only positive frequencies; one element more, as dsps_add_s16_ae32() loads one past the end of its inputs
+__attribute__((aligned(16)))
+static int16_t x_spectrum_sc16[SPECTRAL_FFT_SIZE + 1];
+__attribute__((aligned(16)))
+static int16_t y_spectrum_sc16[SPECTRAL_FFT_SIZE + 1];
+__attribute__((aligned(16)))
+static int16_t centered_sc16[ACCEL_MAX_FRAMES];
+__attribute__((aligned(16)))
+static int16_t window_q15[ACCEL_MAX_FRAMES];
+static int16_t fft_table_sc16[SPECTRAL_FFT_SIZE];
+// centered samples are scaled up to this magnitude, leaving a bit of headroom for complex butterflies
+static const int SC16_INPUT_MAGNITUDE = 1 << 14;
+
+static void prepare_window(size_t length) {
+    dsps_wind_hann_f32(window, length);
+    window_length = length;
+    float sum_of_squares = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum_of_squares += window[i] * window[i];
+        window_q15[i] = (int16_t) lrintf(window[i] * INT16_MAX);
+    }
+    window_gain = 1 / sqrtf(SPECTRAL_FFT_SIZE * sum_of_squares);
+}
+
+esp_err_t spectral_init(void) {
+    esp_err_t err = dsps_fft2r_init_fc32(NULL, SPECTRAL_FFT_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "could not initialize FFT tables, error %d", err);
+        return err;
+    }
+    err = dsps_fft2r_init_sc16(fft_table_sc16, SPECTRAL_FFT_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "could not initialize fixed-point FFT tables, error %d", err);
+        return err;
+    }
+    prepare_window(ACCEL_MAX_FRAMES);
+    return ESP_OK;
+}
+
+// first and last bins within the band, excluding DC and Nyquist ones
+static int band_low_bin(const spectral_band_t& band) {
+    return std::max((int) ceilf(band.low * SPECTRAL_FFT_SIZE / ACCEL_SAMPLE_RATE_HZ), 1);
+}
+
+static int band_high_bin(const spectral_band_t& band) {
+    return std::min((int) (band.high * SPECTRAL_FFT_SIZE / ACCEL_SAMPLE_RATE_HZ), SPECTRAL_FFT_SIZE / 2 - 1);
+}
+
+// amplitude of a sinusoid, which has the same energy as bins within the band
+static float band_amplitude(const float* spectrum, const spectral_band_t& band) {
+    int low = band_low_bin(band);
+    int high = band_high_bin(band);
+    float energy = 0;
+    for (int k = low; k <= high; k++)
+        energy += spectrum[2 * k] * spectrum[2 * k] + spectrum[2 * k + 1] * spectrum[2 * k + 1];
+    return sqrtf(energy) * window_gain;
+}
+
+esp_err_t compute_band_amplitudes(const accel_buffer_dto_t* buffer_dto, const spectral_band_t* bands, size_t count, float* x_out, float* y_out) {
+    size_t n = buffer_dto->buffer_count;
+    if (n == 0 || n > ACCEL_MAX_FRAMES)
+        return ESP_ERR_INVALID_SIZE;
+    if (n != window_length)
+        prepare_window(n);
+
+    // remove gravity, so that it does not leak into low frequencies
+    const int16_t* x = buffer_dto->x;
+    const int16_t* y = buffer_dto->y;
+    int32_t sum_x = 0, sum_y = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum_x += x[i];
+        sum_y += y[i];
+    }
+    float mean_x = (float) sum_x / n;
+    float mean_y = (float) sum_y / n;
+
+    for (size_t i = 0; i < n; i++) {
+        fft_data[2 * i] = (x[i] - mean_x) * window[i];
+        fft_data[2 * i + 1] = (y[i] - mean_y) * window[i];
+    }
+    std::fill(fft_data + 2 * n, fft_data + 2 * SPECTRAL_FFT_SIZE, 0.0f);
+
+    dsps_fft2r_fc32(fft_data, SPECTRAL_FFT_SIZE);
+    dsps_bit_rev_fc32(fft_data, SPECTRAL_FFT_SIZE);
+    // split the result into spectra of x (first half) and y (second half)
+    dsps_cplx2reC_fc32(fft_data, SPECTRAL_FFT_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        x_out[i] = band_amplitude(fft_data, bands[i]);
+        y_out[i] = band_amplitude(fft_data + SPECTRAL_FFT_SIZE, bands[i]);
+    }
+    return ESP_OK;
+}
+
+static int bit_width(uint32_t value) {
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+// same as band_amplitude(), for a spectrum scaled by 1/N and by 2^exponent
+static float band_amplitude_sc16(const int16_t* spectrum, const spectral_band_t& band, int exponent) {
+    int low = band_low_bin(band);
+    int high = band_high_bin(band);
+    if (high < low)
+        return 0;
+    const int16_t* values = spectrum + 2 * low;
+    int len = 2 * (high - low + 1);
+
+    int64_t energy;
+    if (len >= 4) {
+        // dsps_dotprod_s16() returns 16 bits, so pick the shift that keeps the sum of squares within them
+        int peak = 0;
+        for (int i = 0; i < len; i++)
+            peak = std::max(peak, abs(values[i]));
+        int shift = std::min(std::max(30 - 2 * bit_width(peak) - bit_width(len), 0), 15);
+        int16_t scaled_energy;
+        dsps_dotprod_s16(values, values, &scaled_energy, len, shift);
+        energy = (int64_t) scaled_energy << (15 - shift);
+    } else {
+        // a single bin is too short for the dot product kernel
+        energy = (int32_t) values[0] * values[0] + (int32_t) values[1] * values[1];
+    }
+    return ldexpf(sqrtf((float) energy) * 2 * SPECTRAL_FFT_SIZE * window_gain, -exponent);
+}
+
+static int16_t rounded_mean(int32_t sum, int32_t count) {
+    return (sum + (sum < 0 ? -count : count) / 2) / count;
+}
+
+esp_err_t compute_band_amplitudes_s16(const accel_buffer_dto_t* buffer_dto, const spectral_band_t* bands, size_t count, float* x_out, float* y_out) {
+    size_t n = buffer_dto->buffer_count;
+    if (n == 0 || n > ACCEL_MAX_FRAMES)
+        return ESP_ERR_INVALID_SIZE;
+    if (n != window_length)
+        prepare_window(n);
+
+    const int16_t* x = buffer_dto->x;
+    const int16_t* y = buffer_dto->y;
+    int32_t sum_x = 0, sum_y = 0;
+    int16_t min_x = INT16_MAX, max_x = INT16_MIN, min_y = INT16_MAX, max_y = INT16_MIN;
+    for (size_t i = 0; i < n; i++) {
+        sum_x += x[i];
+        sum_y += y[i];
+        min_x = std::min(min_x, x[i]);
+        max_x = std::max(max_x, x[i]);
+        min_y = std::min(min_y, y[i]);
+        max_y = std::max(max_y, y[i]);
+    }
+    int16_t neg_mean_x = -rounded_mean(sum_x, n);
+    int16_t neg_mean_y = -rounded_mean(sum_y, n);
+
+    // block floating point: both axes share an exponent, so that their spectra can be split after a single FFT
+    int range = std::max({max_x + neg_mean_x, -(min_x + neg_mean_x), max_y + neg_mean_y, -(min_y + neg_mean_y), 1});
+    int exponent = 0;
+    while (exponent < 15 && (range << (exponent + 1)) <= SC16_INPUT_MAGNITUDE)
+        exponent++;
+    while (exponent <= 0 && (range >> -exponent) > SC16_INPUT_MAGNITUDE)
+        exponent--;
+
+    // remove gravity, then window and scale each axis into its half of the complex input;
+    // dsps_add_s16() reads x and y one element past n, their arrays in the accelerometer slot have room for it
+    dsps_add_s16(x, &neg_mean_x, centered_sc16, n, 1, 0, 1, 0);
+    dsps_mul_s16(centered_sc16, window_q15, fft_data_sc16, n, 1, 1, 2, 15 - exponent);
+    dsps_add_s16(y, &neg_mean_y, centered_sc16, n, 1, 0, 1, 0);
+    dsps_mul_s16(centered_sc16, window_q15, fft_data_sc16 + 1, n, 1, 1, 2, 15 - exponent);
+    std::fill(fft_data_sc16 + 2 * n, fft_data_sc16 + 2 * SPECTRAL_FFT_SIZE, 0);
+
+    // each stage halves the data, so the result is scaled by 1/N
+    dsps_fft2r_sc16(fft_data_sc16, SPECTRAL_FFT_SIZE);
+    dsps_bit_rev_sc16(fft_data_sc16, SPECTRAL_FFT_SIZE);
+
+    // X[k] = (Z[k] + conj(Z[N - k])) / 2, j * Y[k] = (Z[k] - conj(Z[N - k])) / 2
+    for (int k = 0; k < SPECTRAL_FFT_SIZE / 2; k++) {
+        int mirrored = (SPECTRAL_FFT_SIZE - k) % SPECTRAL_FFT_SIZE;
+        x_spectrum_sc16[2 * k] = fft_data_sc16[2 * mirrored];
+        x_spectrum_sc16[2 * k + 1] = -fft_data_sc16[2 * mirrored + 1];
+        y_spectrum_sc16[2 * k] = -fft_data_sc16[2 * mirrored];
+        y_spectrum_sc16[2 * k + 1] = fft_data_sc16[2 * mirrored + 1];
+    }
+    // extra element read from fft_data_sc16 is still within its 2 * SPECTRAL_FFT_SIZE
+    dsps_add_s16(fft_data_sc16, x_spectrum_sc16, x_spectrum_sc16, SPECTRAL_FFT_SIZE, 1, 1, 1, 1);
+    dsps_add_s16(fft_data_sc16, y_spectrum_sc16, y_spectrum_sc16, SPECTRAL_FFT_SIZE, 1, 1, 1, 1);
+
+    for (size_t i = 0; i < count; i++) {
+        x_out[i] = band_amplitude_sc16(x_spectrum_sc16, bands[i], exponent);
+        y_out[i] = band_amplitude_sc16(y_spectrum_sc16, bands[i], exponent);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,272 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "upload_scheduler.h"
+#include "overwatcher_communicator.h"
+#include "wifi_manager.h"
+
+static const char* TAG = "upload";
+
+#define STATUS_LATENCY_MS (CONFIG_UPLOAD_STATUS_LATENCY * 1000)
+#define MAX_HANDLERS 4
+// after wi-fi was not available, and the first delay after something was not delivered
+#define RETRY_DELAY_MS 20000
+// delay after failed delivery doubles up to this, so that an outage of the server does not keep wi-fi busy
+#define RETRY_DELAY_MAX_MS (30 * 60 * 1000)
+// transitions kept while the server is unreachable, the oldest ones are dropped beyond that
+#define STATUS_QUEUE_SIZE 32
+#define STATUS_NVS_NAMESPACE "upload"
+#define STATUS_NVS_KEY "status_events"
+
+typedef struct{
+    int64_t timestamp;      // real time of the transition, microseconds since epoch
+    uint8_t active;
+} status_event_t;
+
+static TaskHandle_t scheduler_handle;
+static SemaphoreHandle_t schedule_lock;
+
+static int64_t deadline = INT64_MAX;    // esp_timer time by which the next window has to be opened
+static int64_t not_before;              // no window before this esp_timer time, while delivery backs off
+static bool status_pending;             // status is repeated even though it did not change
+static int last_status = -1;            // status of the latest transition, -1 until the first one
+static bool version_sent;
+
+// transitions not delivered yet, also stored in NVS to survive reboots, oldest first
+static status_event_t status_events[STATUS_QUEUE_SIZE];
+static size_t status_events_count;
+static uint32_t status_events_dropped;
+static nvs_handle_t status_nvs;
+
+static upload_handler_t handlers[MAX_HANDLERS];
+static size_t handlers_count;
+
+
+static void request_window(int64_t time){
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    if (time < not_before){
+        time = not_before;
+    }
+    if (time < deadline){
+        deadline = time;
+    }
+    xSemaphoreGive(schedule_lock);
+    xTaskNotifyGive(scheduler_handle);
+}
+
+void upload_request(uint32_t latency_ms){
+    request_window(esp_timer_get_time() + (int64_t) latency_ms * 1000);
+}
+
+static int64_t real_time(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+// called with schedule_lock taken; failure leaves the queue in RAM only
+static void store_status_events(void){
+    if (status_nvs == 0){
+        return;
+    }
+    esp_err_t err = status_events_count > 0 ?
+        nvs_set_blob(status_nvs, STATUS_NVS_KEY, status_events, status_events_count * sizeof(status_event_t)) :
+        nvs_erase_key(status_nvs, STATUS_NVS_KEY);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND){
+        err = nvs_commit(status_nvs);
+    }
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "failed to store status events: %s", esp_err_to_name(err));
+    }
+}
+
+static void load_status_events(void){
+    esp_err_t err = nvs_open(STATUS_NVS_NAMESPACE, NVS_READWRITE, &status_nvs);
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "status events will not survive reboot, failed to open NVS: %s", esp_err_to_name(err));
+        status_nvs = 0;
+        return;
+    }
+    size_t size = sizeof(status_events);
+    err = nvs_get_blob(status_nvs, STATUS_NVS_KEY, status_events, &size);
+    if (err == ESP_OK){
+        status_events_count = size / sizeof(status_event_t);
+        ESP_LOGI(TAG, "%zu status events from before reboot are not sent yet", status_events_count);
+    }
+    else if (err != ESP_ERR_NVS_NOT_FOUND){
+        ESP_LOGE(TAG, "failed to load status events: %s", esp_err_to_name(err));
+    }
+}
+
+void upload_status(bool active){
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    if (last_status != active){
+        if (status_events_count == STATUS_QUEUE_SIZE){
+            memmove(status_events, status_events + 1, (STATUS_QUEUE_SIZE - 1) * sizeof(status_event_t));
+            status_events_count--;
+            status_events_dropped++;
+            ESP_LOGE(TAG, "status queue is full, dropped the oldest transition");
+        }
+        status_events[status_events_count++] = (status_event_t) {
+            .timestamp = real_time(),
+            .active = active
+        };
+        last_status = active;
+        store_status_events();
+    }
+    else{
+        status_pending = true;
+    }
+    xSemaphoreGive(schedule_lock);
+    upload_request(STATUS_LATENCY_MS);
+}
+
+esp_err_t upload_register_handler(upload_handler_t handler){
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    if (handlers_count < MAX_HANDLERS){
+        handlers[handlers_count++] = handler;
+    }
+    else{
+        err = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(schedule_lock);
+    return err;
+}
+
+// sends transitions in order, stopping at the first failure worth a retry; returns whether all were delivered
+// transitions rejected by the server for good are dropped, so that they do not hold back the later ones
+static bool upload_status_events(void){
+    static status_event_t events[STATUS_QUEUE_SIZE];
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    size_t count = status_events_count;
+    memcpy(events, status_events, count * sizeof(status_event_t));
+    uint32_t dropped = status_events_dropped;
+    xSemaphoreGive(schedule_lock);
+
+    size_t sent = 0;
+    while (sent < count){
+        esp_err_t err = send_status(events[sent].active, events[sent].timestamp);
+        if (err == ESP_ERR_INVALID_RESPONSE){
+            ESP_LOGE(TAG, "server rejected status transition, dropped it");
+        }
+        else if (err != ESP_OK){
+            break;
+        }
+        sent++;
+    }
+    if (sent > 0){
+        xSemaphoreTake(schedule_lock, portMAX_DELAY);
+        // transitions that came meanwhile are appended, but may have pushed out the oldest of the sent ones
+        size_t remove = sent - (status_events_dropped - dropped < sent ? status_events_dropped - dropped : sent);
+        memmove(status_events, status_events + remove, (status_events_count - remove) * sizeof(status_event_t));
+        status_events_count -= remove;
+        store_status_events();
+        xSemaphoreGive(schedule_lock);
+        ESP_LOGI(TAG, "sent %zu of %zu status transitions", sent, count);
+    }
+    return sent == count;
+}
+
+// returns whether everything pending was delivered, by the scheduler and by the handlers
+static bool upload_pending(void){
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    bool send_status_now = status_pending;
+    bool active = last_status == 1;
+    bool transitions = status_events_count > 0;
+    status_pending = false;
+    size_t count = handlers_count;
+    xSemaphoreGive(schedule_lock);
+
+    bool delivered = true;
+    if (transitions){
+        // the latest transition confirms current status too
+        delivered = upload_status_events();
+    }
+    else if (send_status_now){
+        esp_err_t err = send_status(active, real_time());
+        if (err == ESP_ERR_INVALID_RESPONSE){
+            ESP_LOGE(TAG, "server rejected status, it is not repeated until the next update");
+        }
+        else if (err != ESP_OK){
+            xSemaphoreTake(schedule_lock, portMAX_DELAY);
+            status_pending = true;
+            xSemaphoreGive(schedule_lock);
+            delivered = false;
+        }
+    }
+    if (!version_sent){
+        version_sent = send_version_telemetry() == ESP_OK;
+        delivered &= version_sent;
+    }
+    for (size_t i = 0; i < count; i++){
+        delivered &= handlers[i]();
+    }
+    return delivered;
+}
+
+/*
+ * Opens wi-fi only when the earliest deadline of the requests comes, and then sends everything pending,
+ * so that status, version and telemetry share one association and one connection to the server.
+ */
+static void scheduler_task_function(void* args){
+    uint32_t retry_delay_ms = RETRY_DELAY_MS;
+    while(1){
+        xSemaphoreTake(schedule_lock, portMAX_DELAY);
+        int64_t window_time = deadline;
+        xSemaphoreGive(schedule_lock);
+        int64_t now = esp_timer_get_time();
+        if (window_time > now){
+            // woken up by a request, which may have moved the deadline closer
+            TickType_t wait = window_time == INT64_MAX ? portMAX_DELAY : pdMS_TO_TICKS((window_time - now + 999) / 1000);
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+
+        xSemaphoreTake(schedule_lock, portMAX_DELAY);
+        deadline = INT64_MAX;
+        xSemaphoreGive(schedule_lock);
+
+        // waits for an attempt that starts before the next retry would, wi-fi manager refuses right away otherwise
+        if (communicator_open_window(RETRY_DELAY_MS + WIFI_ATTEMPT_WAIT_MS) != ESP_OK){
+            ESP_LOGE(TAG, "could not start communication, next attempt in %d s", RETRY_DELAY_MS / 1000);
+            request_window(now + (int64_t) RETRY_DELAY_MS * 1000);
+            continue;
+        }
+        bool delivered = upload_pending();
+        communicator_close_window();
+        ESP_LOGI(TAG, "upload window took %lld ms", (esp_timer_get_time() - now) / 1000);
+
+        // requests made meanwhile wait for the retry too, e.g. repeated status or telemetry of a full ring
+        xSemaphoreTake(schedule_lock, portMAX_DELAY);
+        not_before = delivered ? 0 : esp_timer_get_time() + (int64_t) retry_delay_ms * 1000;
+        xSemaphoreGive(schedule_lock);
+        if (delivered){
+            retry_delay_ms = RETRY_DELAY_MS;
+        }
+        else{
+            ESP_LOGE(TAG, "not everything was delivered, next attempt in %u s", retry_delay_ms / 1000);
+            request_window(not_before);
+            retry_delay_ms = retry_delay_ms * 2 < RETRY_DELAY_MAX_MS ? retry_delay_ms * 2 : RETRY_DELAY_MAX_MS;
+        }
+    }
+}
+
+void upload_scheduler_init(void){
+    schedule_lock = xSemaphoreCreateMutex();
+    load_status_events();
+    if (status_events_count > 0){
+        last_status = status_events[status_events_count - 1].active;
+    }
+    xTaskCreate(scheduler_task_function, "upload_task", 8*configMINIMAL_STACK_SIZE, NULL, 5, &scheduler_handle);
+    // version goes out with the first window
+    upload_request(STATUS_LATENCY_MS);
+}
@@ -2,7 +2,13 @@
 #include <esp_wifi_types.h>
 #include "esp_err.h"
 #include "esp_pm.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "nvs.h"
+#include <string.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "freertos/semphr.h"
 
@@ -13,20 +19,57 @@
 static const char* TAG = "wifi";
 
 static esp_pm_lock_handle_t pm_lock_handle;
-/* FreeRTOS event group to signal when we are connected*/
+/* FreeRTOS event group to signal connection state to the scheduler and to the waiting tasks */
 static EventGroupHandle_t s_wifi_event_group;
 
-/* The event group allows multiple bits for each event, but we only care about two events:
- * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
-#define CONNECT_TO_AP_MAXIMUM_RETRY 5
+/* - we are connected to the AP with an IP
+ * - the AP rejected or dropped us
+ * - an attempt failed, set only for a moment to wake up the waiting tasks */
+#define WIFI_CONNECTED_BIT      BIT0
+#define WIFI_DISCONNECTED_BIT   BIT1
+#define WIFI_ATTEMPT_FAILED_BIT BIT2
 
-static int s_retry_num = 0; //counts failed attempts to start communication
+#define FAILURE_WINDOW_US (3600LL * 1000000)
+
+#define AP_NVS_NAMESPACE "wifi_manager"
+#define AP_NVS_KEY "last_ap"
+
+// access point of the last successful connection, to connect without scanning
+typedef struct{
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t valid;
+} ap_cache_t;
+
+static TaskHandle_t connection_handle;
+static bool wifi_started; //accessed only by the connection task
 
 static int comm_request_cnt = 0; //counts communication requests from different tasks
-static SemaphoreHandle_t comm_request_cnt_lock; //lock for comm_request_cnt, as it is a critical region
+static SemaphoreHandle_t comm_request_cnt_lock; //lock for comm_request_cnt and the schedule below, as they are a critical region
+
+static int64_t retry_at;            //esp_timer time before which no attempt is made
+static uint32_t failures_in_row;    //exponent of the backoff
+static int64_t failure_times[CONFIG_WIFI_FAILURE_BUDGET]; //ring of the latest failures, for the hourly budget
+static size_t failure_index;
+static size_t failures_recorded;
+
+static ap_cache_t ap_cache;
+static wifi_config_t sta_config = {
+    .sta = {
+        .ssid = ESP_WIFI_SSID,
+        .password = ESP_WIFI_PASS,
+        .bssid_set = false,
+        .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+        .pmf_cfg = {
+            .capable = true,
+            .required = false
+        },
+    }
+};
+
+static wifi_stats_t stats; //under comm_request_cnt_lock
+static int64_t attempt_start;
+static volatile int64_t associated_time; //set by event handler once the AP accepted us
 
 
 static void event_handler(void* arg, esp_event_base_t event_base,
@@ -34,128 +77,308 @@ static void event_handler(void* arg, esp_event_base_t event_base,
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        associated_time = esp_timer_get_time();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < CONNECT_TO_AP_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*) event_data;
+        if (event->reason == WIFI_REASON_ASSOC_LEAVE) {
+            // we stopped wi-fi ourselves, the event may come late and must not fail the next attempt
+            return;
         }
-        ESP_LOGI(TAG,"connect to the AP fail");
+        // no immediate retry: the scheduler decides when the next attempt is worth its energy
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        xEventGroupSetBits(s_wifi_event_group, WIFI_DISCONNECTED_BIT);
+        xTaskNotifyGive(connection_handle);
+        ESP_LOGI(TAG,"disconnected from the AP");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
 }
 
-static esp_err_t start_communication_impl(){
-    s_retry_num = 0;
-    esp_err_t res = ESP_ERR_WIFI_NOT_CONNECT;
-    esp_pm_lock_acquire(pm_lock_handle); //indicates not to sleep while there is communication via wifi
-    s_wifi_event_group = xEventGroupCreate();
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-
-	wifi_config_t sta_config = {
-		.sta = {
-			.ssid = ESP_WIFI_SSID,
-			.password = ESP_WIFI_PASS,
-			.bssid_set = false,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-            .pmf_cfg = {
-                .capable = true,
-                .required = false
-            },
-		}
-	};
-	ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &sta_config) );
-	ESP_ERROR_CHECK( esp_wifi_start() );
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
+static void stop_wifi_radio(void){
+	esp_wifi_stop();
+    wifi_started = false;
+}
+
+static void stop_wifi(void){
+    stop_wifi_radio();
+    esp_pm_lock_release(pm_lock_handle); //after communication is stopped, esp can enter light sleep mode
+	ESP_LOGI(TAG, "Communication stopped");
+}
+
+static void load_ap_cache(void){
+    nvs_handle_t handle;
+    if (nvs_open(AP_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK){
+        return;
+    }
+    size_t size = sizeof(ap_cache);
+    if (nvs_get_blob(handle, AP_NVS_KEY, &ap_cache, &size) != ESP_OK || size != sizeof(ap_cache)){
+        ap_cache.valid = false;
+    }
+    nvs_close(handle);
+}
+
+// stored in NVS only when changed, to spare the flash
+static void store_ap_cache(const ap_cache_t* cache){
+    if (memcmp(cache, &ap_cache, sizeof(ap_cache)) == 0){
+        return;
+    }
+    ap_cache = *cache;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(AP_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK){
+        err = nvs_set_blob(handle, AP_NVS_KEY, &ap_cache, sizeof(ap_cache));
+        if (err == ESP_OK){
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK){
+        ESP_LOGE(TAG, "failed to store AP: %s", esp_err_to_name(err));
+    }
+}
+
+// directed connection to the cached AP skips the scan of all channels
+static void set_target_ap(bool fast){
+    sta_config.sta.bssid_set = fast;
+    sta_config.sta.channel = fast ? ap_cache.channel : 0;
+    if (fast){
+        memcpy(sta_config.sta.bssid, ap_cache.bssid, sizeof(ap_cache.bssid));
+    }
+    ESP_ERROR_CHECK( esp_wifi_set_config(WIFI_IF_STA, &sta_config) );
+}
+
+static bool wait_for_ip(uint32_t timeout_ms){
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_DISCONNECTED_BIT);
+    associated_time = 0;
+    attempt_start = esp_timer_get_time();
+    ESP_ERROR_CHECK( esp_wifi_start() );
+    wifi_started = true;
+
     EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+            WIFI_CONNECTED_BIT | WIFI_DISCONNECTED_BIT,
             pdFALSE,
             pdFALSE,
-            portMAX_DELAY);
-    
-     /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
+            pdMS_TO_TICKS(timeout_ms));
     if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s",
-                 ESP_WIFI_SSID);
-        res = ESP_OK;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s",
-                 ESP_WIFI_SSID);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+        return true;
     }
+    stop_wifi_radio();
+    return false;
+}
 
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
-    vEventGroupDelete(s_wifi_event_group);
+static void account_connection(bool fast){
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
+    stats.connections++;
+    stats.fast_connections += fast;
+    stats.last_connect_ms = (now - attempt_start) / 1000;
+    stats.last_ip_ms = associated_time > 0 ? (now - associated_time) / 1000 : 0;
+    stats.connect_time_ms += stats.last_connect_ms;
+    xSemaphoreGive(comm_request_cnt_lock);
+    ESP_LOGI(TAG, "connected to ap SSID:%s in %u ms, %u ms of them to get IP%s", ESP_WIFI_SSID,
+        stats.last_connect_ms, stats.last_ip_ms, fast ? ", without scan" : "");
+}
 
-    if (res != ESP_OK){
-        stop_communication();
+// single attempt within CONFIG_WIFI_CONNECT_TIMEOUT_MS, wi-fi stays on only if it succeeds
+static bool connect_attempt(void){
+    esp_pm_lock_acquire(pm_lock_handle); //indicates not to sleep while there is communication via wifi
+    int64_t deadline = esp_timer_get_time() + (int64_t) CONFIG_WIFI_CONNECT_TIMEOUT_MS * 1000;
+    bool fast = ap_cache.valid;
+    set_target_ap(fast);
+    // directed connection gets only a part of the timeout, the rest is left for the scan
+    bool success = wait_for_ip(fast ? CONFIG_WIFI_FAST_CONNECT_TIMEOUT_MS : CONFIG_WIFI_CONNECT_TIMEOUT_MS);
+    int64_t remaining_ms = (deadline - esp_timer_get_time()) / 1000;
+    if (!success && fast && remaining_ms > 0){
+        // AP may have moved to another channel or been replaced, the scan finds it
+        ESP_LOGI(TAG, "cached AP is not available, scanning");
+        xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
+        stats.fast_fallbacks++;
+        xSemaphoreGive(comm_request_cnt_lock);
+        fast = false;
+        set_target_ap(false);
+        success = wait_for_ip(remaining_ms);
+    }
+    if (!success){
+        ESP_LOGI(TAG, "Failed to connect to SSID:%s", ESP_WIFI_SSID);
+        esp_pm_lock_release(pm_lock_handle);
+        return false;
+    }
+    account_connection(fast);
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK){
+        ap_cache_t cache = { .channel = ap.primary, .valid = true };
+        memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+        store_ap_cache(&cache);
     }
-    return res;
+    return true;
 }
 
-static void stop_communication_impl(void){
-	esp_wifi_stop();
-    esp_pm_lock_release(pm_lock_handle); //after communication is stopped, esp can enter light sleep mode
-	ESP_LOGI(TAG, "Communication stopped");
+// called with comm_request_cnt_lock taken
+static void schedule_next_attempt(bool success, int64_t now){
+    if (success){
+        failures_in_row = 0;
+        retry_at = 0;
+        return;
+    }
+    uint32_t backoff = CONFIG_WIFI_BACKOFF_MIN_MS;
+    for (uint32_t i = 0; i < failures_in_row && backoff < CONFIG_WIFI_BACKOFF_MAX_MS; i++){
+        backoff *= 2;
+    }
+    if (backoff > CONFIG_WIFI_BACKOFF_MAX_MS){
+        backoff = CONFIG_WIFI_BACKOFF_MAX_MS;
+    }
+    failures_in_row++;
+    // jitter keeps nodes that lost the same AP from retrying in lockstep
+    uint32_t delay = backoff / 2 + esp_random() % (backoff / 2 + 1);
+    retry_at = now + (int64_t) delay * 1000;
+
+    failure_times[failure_index] = now;
+    failure_index = (failure_index + 1) % CONFIG_WIFI_FAILURE_BUDGET;
+    if (failures_recorded < CONFIG_WIFI_FAILURE_BUDGET){
+        failures_recorded++;
+    }
+    // the oldest failure of the budget is the one to be overwritten next
+    int64_t budget_renewal = failure_times[failure_index] + FAILURE_WINDOW_US;
+    if (failures_recorded == CONFIG_WIFI_FAILURE_BUDGET && budget_renewal > retry_at){
+        retry_at = budget_renewal;
+        ESP_LOGW(TAG, "%d attempts failed within an hour", CONFIG_WIFI_FAILURE_BUDGET);
+    }
+    ESP_LOGI(TAG, "next attempt in %lld s", (retry_at - now) / 1000000);
 }
 
-esp_err_t start_communication(){
-    esp_err_t result;
+/*
+ * Connects while there are requests, one attempt at a time with backoff between failures,
+ * and turns wi-fi off once the last request is released.
+ */
+static void connection_task_function(void* args){
+    while(1){
+        xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
+        bool wanted = comm_request_cnt > 0;
+        bool connected = xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT;
+        int64_t next_attempt = retry_at;
+        bool stop = wifi_started && (!wanted || !connected);
+        if (stop){
+            // new requests will wait for the next attempt instead of using connection going down
+            xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        }
+        xSemaphoreGive(comm_request_cnt_lock);
+
+        if (stop){
+            // nobody needs the connection anymore, or the AP dropped it
+            stop_wifi();
+            continue;
+        }
+        if (!wanted || connected){
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if (next_attempt > now){
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((next_attempt - now + 999) / 1000));
+            continue;
+        }
+
+        bool success = connect_attempt();
+        xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
+        schedule_next_attempt(success, esp_timer_get_time());
+        xSemaphoreGive(comm_request_cnt_lock);
+        if (!success){
+            xEventGroupSetBits(s_wifi_event_group, WIFI_ATTEMPT_FAILED_BIT);
+            xEventGroupClearBits(s_wifi_event_group, WIFI_ATTEMPT_FAILED_BIT);
+        }
+    }
+}
+
+void wifi_request_connection(void){
     xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
-    if (comm_request_cnt == 0){
-        result = start_communication_impl();
-        if (result == ESP_OK) comm_request_cnt++;
+    comm_request_cnt++;
+    xSemaphoreGive(comm_request_cnt_lock);
+    xTaskNotifyGive(connection_handle);
+}
+
+esp_err_t wifi_wait_connected(uint32_t timeout_ms){
+    int64_t deadline = timeout_ms == WIFI_WAIT_FOREVER ? INT64_MAX : esp_timer_get_time() + (int64_t) timeout_ms * 1000;
+    while(1){
+        xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
+        bool connected = xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT;
+        int64_t next_attempt = retry_at;
+        xSemaphoreGive(comm_request_cnt_lock);
+        if (connected){
+            return ESP_OK;
+        }
+        if (next_attempt > deadline - (int64_t) CONFIG_WIFI_CONNECT_TIMEOUT_MS * 1000){
+            // next attempt may not end before the deadline, connection it makes would be dropped unused
+            return ESP_ERR_WIFI_NOT_CONNECT;
+        }
+        int64_t now = esp_timer_get_time();
+        if (now >= deadline){
+            return ESP_ERR_TIMEOUT;
+        }
+        TickType_t wait = deadline == INT64_MAX ? portMAX_DELAY : pdMS_TO_TICKS((deadline - now + 999) / 1000);
+        xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_ATTEMPT_FAILED_BIT, pdFALSE, pdFALSE, wait);
     }
-    else{
-        result = ESP_OK;
-        comm_request_cnt++;
+}
+
+esp_err_t start_communication(uint32_t timeout_ms){
+    wifi_request_connection();
+    esp_err_t result = wifi_wait_connected(timeout_ms);
+    if (result != ESP_OK){
+        stop_communication();
     }
-    xSemaphoreGive(comm_request_cnt_lock);
     return result;
 }
 
 
 void stop_communication(void){
     xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
-    if (comm_request_cnt == 1){
-        stop_communication_impl();
-    }
     comm_request_cnt--;
     xSemaphoreGive(comm_request_cnt_lock);
+    xTaskNotifyGive(connection_handle);
 }
 
 
 void wifi_init(void){
     ESP_ERROR_CHECK( esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "communication", &pm_lock_handle) );
-    esp_netif_create_default_wifi_sta();
+    esp_netif_t* netif = esp_netif_create_default_wifi_sta();
+#ifdef CONFIG_WIFI_STATIC_IP
+    // no DHCP exchange at all, connected is the same as got IP
+    esp_netif_ip_info_t ip_info;
+    ESP_ERROR_CHECK( esp_netif_str_to_ip4(CONFIG_WIFI_STATIC_IP_ADDRESS, &ip_info.ip) );
+    ESP_ERROR_CHECK( esp_netif_str_to_ip4(CONFIG_WIFI_STATIC_NETMASK, &ip_info.netmask) );
+    ESP_ERROR_CHECK( esp_netif_str_to_ip4(CONFIG_WIFI_STATIC_GATEWAY, &ip_info.gw) );
+    ESP_ERROR_CHECK( esp_netif_dhcpc_stop(netif) );
+    ESP_ERROR_CHECK( esp_netif_set_ip_info(netif, &ip_info) );
+    esp_netif_dns_info_t dns_info = { .ip.type = ESP_IPADDR_TYPE_V4 };
+    ESP_ERROR_CHECK( esp_netif_str_to_ip4(CONFIG_WIFI_STATIC_DNS, &dns_info.ip.u_addr.ip4) );
+    ESP_ERROR_CHECK( esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns_info) );
+#endif
     wifi_init_config_t init_config = WIFI_INIT_CONFIG_DEFAULT();
 	ESP_ERROR_CHECK( esp_wifi_init(&init_config) );
 	ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
 	ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
-    
+    load_ap_cache();
+
     comm_request_cnt_lock = xSemaphoreCreateMutex();
-}
\ No newline at end of file
+    s_wifi_event_group = xEventGroupCreate();
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &event_handler,
+                                                        NULL,
+                                                        NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        NULL));
+    xTaskCreate(connection_task_function, "wifi_task", 4*configMINIMAL_STACK_SIZE, NULL, 5, &connection_handle);
+}
+
+void wifi_get_stats(wifi_stats_t* out){
+    xSemaphoreTake(comm_request_cnt_lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(comm_request_cnt_lock);
+}